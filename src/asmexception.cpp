@@ -37,12 +37,12 @@ using namespace std;
 /**
 	AsmException_FileAccessError::Print()
 
-	Outputs to stderr an error message relating to an I/O exception
+	Outputs an error message relating to an I/O exception
 */
 /*************************************************************************************************/
-void AsmException_FileError::Print() const
+void AsmException_FileError::Print( ostream& stream, bool /*useVisualCppErrorFormat*/ ) const
 {
-	cerr << "Error: " << m_filename << ": " << Message() << endl;
+	stream << "Error: " << m_filename << ": " << Message() << endl;
 }
 
 
@@ -51,28 +51,28 @@ void AsmException_FileError::Print() const
 /**
 	AsmException_SyntaxError::Print()
 
-	Outputs to stderr an error message regarding a syntax error
+	Outputs an error message regarding a syntax error
 */
 /*************************************************************************************************/
-void AsmException_SyntaxError::Print() const
+void AsmException_SyntaxError::Print( ostream& stream, bool useVisualCppErrorFormat ) const
 {
 	assert( !m_filename.empty() );
 	assert( !m_lineNumber.empty() );
 	assert( m_filename.size() == m_lineNumber.size() ) ;
 
-	cerr << ErrorLocation(0);
-	cerr << ": error: ";
-	cerr << Message() << m_extra << endl << endl;
-	cerr << m_line << endl;
-	cerr << string( m_column, ' ' ) << "^" << endl;
+	stream << ErrorLocation( 0, useVisualCppErrorFormat );
+	stream << ": error: ";
+	stream << Message() << m_extra << endl << endl;
+	stream << m_line << endl;
+	stream << string( m_column, ' ' ) << "^" << endl;
 
 	if ( m_filename.size() > 1 )
 	{
-		cerr << endl;
-		cerr << "Call stack:" << endl;
+		stream << endl;
+		stream << "Call stack:" << endl;
 		for (size_t i = 1; i < m_filename.size(); i++)
 		{
-			cerr << ErrorLocation(i) << endl;
+			stream << ErrorLocation( i, useVisualCppErrorFormat ) << endl;
 		}
 	}
 }
@@ -86,7 +86,7 @@ void AsmException_SyntaxError::Print() const
 	Formats filename and line number as a string in the appropriate format
 */
 /*************************************************************************************************/
-std::string AsmException_SyntaxError::ErrorLocation( size_t i ) const
+std::string AsmException_SyntaxError::ErrorLocation( size_t i, bool useVisualCppErrorFormat ) const
 {
-	return StringUtils::FormattedErrorLocation( m_filename[ i ], m_lineNumber[ i ] );
+	return StringUtils::FormattedErrorLocation( m_filename[ i ], m_lineNumber[ i ], useVisualCppErrorFormat );
 }
@@ -24,6 +24,7 @@
 #define ASMEXCEPTION_H_
 
 
+#include <ostream>
 #include <string>
 #include <vector>
 
@@ -42,7 +43,8 @@ public:
 	AsmException() {}
 	virtual ~AsmException() {}
 
-	virtual void Print() const = 0;
+	// Errors are located in Visual C++ style, file(line), rather than file:line if asked
+	virtual void Print( std::ostream& stream, bool useVisualCppErrorFormat ) const = 0;
 };
 
 
@@ -71,7 +73,9 @@ public:
 
 	virtual ~AsmException_FileError() {}
 
-	virtual void Print() const;
+	const std::string& GetFilename() const { return m_filename; }
+
+	virtual void Print( std::ostream& stream, bool useVisualCppErrorFormat ) const;
 
 	virtual const char* Message() const
 	{
@@ -124,6 +128,10 @@ DEFINE_FILE_EXCEPTION( DiscFull, "No room on DFS disc image full." );
 DEFINE_FILE_EXCEPTION( BadName, "Bad DFS filename." );
 DEFINE_FILE_EXCEPTION( TooManyFiles, "Too many files on DFS disc image (max 31)." );
 DEFINE_FILE_EXCEPTION( FileExists, "File already exists on DFS disc image." );
+DEFINE_FILE_EXCEPTION( BadDrive, "No such drive on DFS disc image." );
+DEFINE_FILE_EXCEPTION( NotSaved, "File in LOADORDER was not saved to the DFS disc image." );
+DEFINE_FILE_EXCEPTION( OpenDepFile, "Could not open dependency file for writing." );
+DEFINE_FILE_EXCEPTION( WriteDepFile, "Problem writing to dependency file." );
 
 
 /*************************************************************************************************/
@@ -160,7 +168,14 @@ public:
 	void SetFilename( const std::string& filename )	{ m_filename.push_back( filename ); }
 	void SetLineNumber( int lineNumber )		{ m_lineNumber.push_back( lineNumber ); }
 
-	virtual void Print() const;
+	// Where the error happened: the innermost file and line, if it's known
+	std::string GetFilename() const			{ return m_filename.empty() ? std::string() : m_filename[ 0 ]; }
+	int GetLineNumber() const				{ return m_lineNumber.empty() ? 0 : m_lineNumber[ 0 ]; }
+	const std::string& GetLine() const		{ return m_line; }
+	int GetColumn() const					{ return m_column; }
+	const std::string& GetExtra() const		{ return m_extra; }
+
+	virtual void Print( std::ostream& stream, bool useVisualCppErrorFormat ) const;
 	virtual const char* Message() const
 	{
 		return "Unspecified syntax error.";
@@ -169,7 +184,7 @@ public:
 
 protected:
 
-	std::string	ErrorLocation( size_t i ) const;
+	std::string	ErrorLocation( size_t i, bool useVisualCppErrorFormat ) const;
 
 	std::string			m_line;
 	int				m_column;
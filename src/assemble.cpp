@@ -28,6 +28,7 @@
 #include <sstream>
 
 #include "lineparser.h"
+#include "assemblycontext.h"
 #include "globaldata.h"
 #include "objectcode.h"
 #include "asmexception.h"
@@ -119,6 +120,59 @@ const LineParser::OpcodeData	LineParser::m_gaOpcodeTable[] =
 
 #undef X
 
+const LineParser::OpcodeIndex	LineParser::m_gOpcodeIndex;
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::OpcodeIndex::OpcodeIndex()
+
+	Builds the per-CPU index of the opcode table by packed mnemonic
+*/
+/*************************************************************************************************/
+LineParser::OpcodeIndex::OpcodeIndex()
+{
+	memset( m_opcodes, -1, sizeof m_opcodes );
+
+	for ( int i = 0; i < static_cast<int>( sizeof m_gaOpcodeTable / sizeof( OpcodeData ) ); i++ )
+	{
+		const char*	token = m_gaOpcodeTable[ i ].m_pName;
+		assert( m_gaOpcodeTable[ i ].m_nameLength == 3 );
+
+		int packed = PackMnemonic( token[ 0 ], token[ 1 ], token[ 2 ] );
+
+		// an instruction is available on its own CPU and any later one
+
+		for ( int cpu = m_gaOpcodeTable[ i ].m_cpu; cpu <= CPU_65C02; cpu++ )
+		{
+			assert( m_opcodes[ cpu ][ packed ] == -1 );
+			m_opcodes[ cpu ][ packed ] = static_cast< signed char >( i );
+		}
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::OpcodeIndex::PackMnemonic()
+
+	Packs three letters into an integer, 5 bits each, ignoring case
+
+	@return		The packed mnemonic, or -1 if any of the characters are not letters
+*/
+/*************************************************************************************************/
+int LineParser::OpcodeIndex::PackMnemonic( char c1, char c2, char c3 )
+{
+	if ( !Ascii::IsAlpha( c1 ) || !Ascii::IsAlpha( c2 ) || !Ascii::IsAlpha( c3 ) )
+	{
+		return -1;
+	}
+
+	return ( ( c1 & 0x1F ) << 10 ) | ( ( c2 & 0x1F ) << 5 ) | ( c3 & 0x1F );
+}
+
 /*************************************************************************************************/
 /**
 	LineParser::GetInstructionAndAdvanceColumn()
@@ -132,7 +186,7 @@ const LineParser::OpcodeData	LineParser::m_gaOpcodeTable[] =
 /*************************************************************************************************/
 int LineParser::GetInstructionAndAdvanceColumn()
 {
-	return GetInstructionAndAdvanceColumn( GlobalData::Instance().RequireDistinctOpcodes(), ObjectCode::Instance().GetCPU() );
+	return GetInstructionAndAdvanceColumn( m_context.GetGlobalData().RequireDistinctOpcodes(), m_context.GetObjectCode().GetCPU() );
 }
 
 /*************************************************************************************************/
@@ -150,52 +204,46 @@ int LineParser::GetInstructionAndAdvanceColumn()
 /*************************************************************************************************/
 int LineParser::GetInstructionAndAdvanceColumn( bool requireDistinctOpcodes,  CPU_TYPE effectiveCPU )
 {
-	for ( int i = 0; i < static_cast<int>( sizeof m_gaOpcodeTable / sizeof( OpcodeData ) ); i++ )
+	// all mnemonics are three letters long
+
+	const size_t len = 3;
+
+	if ( m_column + len > m_line.length() )
 	{
-		int			cpu		= m_gaOpcodeTable[ i ].m_cpu;
-		const char*	token	= m_gaOpcodeTable[ i ].m_pName;
-		size_t		len		= m_gaOpcodeTable[ i ].m_nameLength;
-		assert(len == strlen( token ));
+		return -1;
+	}
 
-		// ignore instructions not for current cpu
-		if ( cpu > effectiveCPU )
-			continue;
+	int packed = OpcodeIndex::PackMnemonic( m_line[ m_column ], m_line[ m_column + 1 ], m_line[ m_column + 2 ] );
 
-		// see if token matches
+	if ( packed == -1 )
+	{
+		return -1;
+	}
 
-		bool bMatch = true;
-		for ( unsigned int j = 0; j < len; j++ )
-		{
-			if ( token[ j ] != Ascii::ToUpper( m_line[ m_column + j ] ) )
-			{
-				bMatch = false;
-				break;
-			}
-		}
+	int i = m_gOpcodeIndex.m_opcodes[ effectiveCPU ][ packed ];
+
+	if ( i == -1 )
+	{
+		return -1;
+	}
 
-		// The token matches so far, but (optionally) check there's nothing after it; this prevents 
-		// false matches where a macro name begins with an opcode, at the cost of disallowing 
-		// things like "foo=&70:stafoo".
-		if ( requireDistinctOpcodes && bMatch )
+	// The token matches so far, but (optionally) check there's nothing after it; this prevents 
+	// false matches where a macro name begins with an opcode, at the cost of disallowing 
+	// things like "foo=&70:stafoo".
+	if ( requireDistinctOpcodes )
+	{
+		std::string::size_type k = m_column + len;
+		if ( k < m_line.length() )
 		{
-			std::string::size_type k = m_column + len;
-			if ( k < m_line.length() )
+			if ( !isspace( m_line[ k ] ) && m_line[ k ] != ':' )
 			{
-				if ( !isspace( m_line[ k ] ) && m_line[ k ] != ':' )
-				{
-					bMatch = false;
-				}
+				return -1;
 			}
 		}
-
-		if ( bMatch )
-		{
-			m_column += len;
-			return i;
-		}
 	}
 
-	return -1;
+	m_column += len;
+	return i;
 }
 
 
@@ -207,7 +255,7 @@ int LineParser::GetInstructionAndAdvanceColumn( bool requireDistinctOpcodes,  CP
 bool LineParser::HasAddressingMode( int instructionIndex, ADDRESSING_MODE mode )
 {
 	int i = m_gaOpcodeTable[ instructionIndex ].m_aOpcodes[ mode ];
-	return ( i != -1 && (i & 0xFF00) <= (ObjectCode::Instance().GetCPU() << 8) );
+	return ( i != -1 && (i & 0xFF00) <= (m_context.GetObjectCode().GetCPU() << 8) );
 }
 
 
@@ -238,22 +286,22 @@ void LineParser::Assemble1( int instructionIndex, ADDRESSING_MODE mode )
 
 	if ( m_sourceCode->ShouldOutputAsm() )
 	{
-		cout << uppercase << hex << setfill( '0' ) << "     ";
-		cout << setw(4) << ObjectCode::Instance().GetPC() << "   ";
-		cout << setw(2) << GetOpcode( instructionIndex, mode ) << "         ";
-		cout << m_gaOpcodeTable[ instructionIndex ].m_pName;
+		m_context.GetOutput() << uppercase << hex << setfill( '0' ) << "     ";
+		m_context.GetOutput() << setw(4) << m_context.GetObjectCode().GetPC() << "   ";
+		m_context.GetOutput() << setw(2) << GetOpcode( instructionIndex, mode ) << "         ";
+		m_context.GetOutput() << m_gaOpcodeTable[ instructionIndex ].m_pName;
 
 		if ( mode == ACC )
 		{
-			cout << " A";
+			m_context.GetOutput() << " A";
 		}
 
-		cout << endl << nouppercase << dec << setfill( ' ' );
+		m_context.GetOutput() << endl << nouppercase << dec << setfill( ' ' );
 	}
 
 	try
 	{
-		ObjectCode::Instance().Assemble1( GetOpcode( instructionIndex, mode ) );
+		m_context.GetObjectCode().Assemble1( GetOpcode( instructionIndex, mode ) );
 	}
 	catch ( AsmException_AssembleError& e )
 	{
@@ -277,57 +325,57 @@ void LineParser::Assemble2( int instructionIndex, ADDRESSING_MODE mode, unsigned
 
 	if ( m_sourceCode->ShouldOutputAsm() )
 	{
-		cout << uppercase << hex << setfill( '0' ) << "     ";
-		cout << setw(4) << ObjectCode::Instance().GetPC() << "   ";
-		cout << setw(2) << GetOpcode( instructionIndex, mode ) << " ";
-		cout << setw(2) << value << "      ";
-		cout << m_gaOpcodeTable[ instructionIndex ].m_pName << " ";
+		m_context.GetOutput() << uppercase << hex << setfill( '0' ) << "     ";
+		m_context.GetOutput() << setw(4) << m_context.GetObjectCode().GetPC() << "   ";
+		m_context.GetOutput() << setw(2) << GetOpcode( instructionIndex, mode ) << " ";
+		m_context.GetOutput() << setw(2) << value << "      ";
+		m_context.GetOutput() << m_gaOpcodeTable[ instructionIndex ].m_pName << " ";
 
 		if ( mode == IMM )
 		{
-			cout << "#";
+			m_context.GetOutput() << "#";
 		}
 		else if ( mode == IND || mode == INDX || mode == INDY )
 		{
-			cout << "(";
+			m_context.GetOutput() << "(";
 		}
 
 		if ( mode == REL )
 		{
-			cout << "&" << setw(4) << ObjectCode::Instance().GetPC() + 2 + static_cast< signed char >( value );
+			m_context.GetOutput() << "&" << setw(4) << m_context.GetObjectCode().GetPC() + 2 + static_cast< signed char >( value );
 		}
 		else
 		{
-			cout << "&" << setw(2) << value;
+			m_context.GetOutput() << "&" << setw(2) << value;
 		}
 
 		if ( mode == ZPX )
 		{
-			cout << ",X";
+			m_context.GetOutput() << ",X";
 		}
 		else if ( mode == ZPY )
 		{
-			cout << ",Y";
+			m_context.GetOutput() << ",Y";
 		}
 		else if ( mode == IND )
 		{
-			cout << ")";
+			m_context.GetOutput() << ")";
 		}
 		else if ( mode == INDX )
 		{
-			cout << ",X)";
+			m_context.GetOutput() << ",X)";
 		}
 		else if ( mode == INDY )
 		{
-			cout << "),Y";
+			m_context.GetOutput() << "),Y";
 		}
 
-		cout << endl << nouppercase << dec << setfill( ' ' );
+		m_context.GetOutput() << endl << nouppercase << dec << setfill( ' ' );
 	}
 
 	try
 	{
-		ObjectCode::Instance().Assemble2( GetOpcode( instructionIndex, mode ), value );
+		m_context.GetObjectCode().Assemble2( GetOpcode( instructionIndex, mode ), value );
 	}
 	catch ( AsmException_AssembleError& e )
 	{
@@ -351,43 +399,43 @@ void LineParser::Assemble3( int instructionIndex, ADDRESSING_MODE mode, unsigned
 
 	if ( m_sourceCode->ShouldOutputAsm() )
 	{
-		cout << uppercase << hex << setfill( '0' ) << "     ";
-		cout << setw(4) << ObjectCode::Instance().GetPC() << "   ";
-		cout << setw(2) << GetOpcode( instructionIndex, mode ) << " ";
-		cout << setw(2) << ( value & 0xFF ) << " ";
-		cout << setw(2) << ( ( value >> 8 ) & 0xFF ) << "   ";
-		cout << m_gaOpcodeTable[ instructionIndex ].m_pName << " ";
+		m_context.GetOutput() << uppercase << hex << setfill( '0' ) << "     ";
+		m_context.GetOutput() << setw(4) << m_context.GetObjectCode().GetPC() << "   ";
+		m_context.GetOutput() << setw(2) << GetOpcode( instructionIndex, mode ) << " ";
+		m_context.GetOutput() << setw(2) << ( value & 0xFF ) << " ";
+		m_context.GetOutput() << setw(2) << ( ( value >> 8 ) & 0xFF ) << "   ";
+		m_context.GetOutput() << m_gaOpcodeTable[ instructionIndex ].m_pName << " ";
 
 		if ( mode == IND16 || mode == IND16X )
 		{
-			cout << "(";
+			m_context.GetOutput() << "(";
 		}
 
-		cout << "&" << setw(4) << value;
+		m_context.GetOutput() << "&" << setw(4) << value;
 
 		if ( mode == ABSX )
 		{
-			cout << ",X";
+			m_context.GetOutput() << ",X";
 		}
 		else if ( mode == ABSY )
 		{
-			cout << ",Y";
+			m_context.GetOutput() << ",Y";
 		}
 		else if ( mode == IND16 )
 		{
-			cout << ")";
+			m_context.GetOutput() << ")";
 		}
 		else if ( mode == IND16X )
 		{
-			cout << ",X)";
+			m_context.GetOutput() << ",X)";
 		}
 
-		cout << endl << nouppercase << dec << setfill( ' ' );
+		m_context.GetOutput() << endl << nouppercase << dec << setfill( ' ' );
 	}
 
 	try
 	{
-		ObjectCode::Instance().Assemble3( GetOpcode( instructionIndex, mode ), value );
+		m_context.GetObjectCode().Assemble3( GetOpcode( instructionIndex, mode ), value );
 	}
 	catch ( AsmException_AssembleError& e )
 	{
@@ -440,20 +488,9 @@ void LineParser::HandleAssembler( int instruction )
 
 		int value;
 
-		try
-		{
-			value = EvaluateExpressionAsInt();
-		}
-		catch ( AsmException_SyntaxError_SymbolNotDefined& )
+		if ( !TryEvaluateExpressionAsInt( value ) )
 		{
-			if ( GlobalData::Instance().IsFirstPass() )
-			{
-				value = 0;
-			}
-			else
-			{
-				throw;
-			}
+			value = 0;
 		}
 
 		if ( value > 0xFF )
@@ -512,22 +549,11 @@ void LineParser::HandleAssembler( int instruction )
 
 		int value;
 
-		try
+		// passing true to EvaluateExpression is a hack which allows us to terminate the expression by
+		// an extra close bracket.
+		if ( !TryEvaluateExpressionAsInt( value, true ) )
 		{
-			// passing true to EvaluateExpression is a hack which allows us to terminate the expression by
-			// an extra close bracket.
-			value = EvaluateExpressionAsInt( true );
-		}
-		catch ( AsmException_SyntaxError_SymbolNotDefined& )
-		{
-			if ( GlobalData::Instance().IsFirstPass() )
-			{
-				value = 0;
-			}
-			else
-			{
-				throw;
-			}
+			value = 0;
 		}
 
 		// the only valid character to find here is ',' for (ind,X) or (ind16,X) and ')' for (ind),Y or (ind16) or (ind)
@@ -724,10 +750,15 @@ void LineParser::HandleAssembler( int instruction )
 	oldColumn = m_column;
 	int value;
 
-	try
+	if ( !TryEvaluateExpressionAsInt( value ) )
+	{
+		// this allows branches to assemble when the value is unknown due to a label not having
+		// yet been defined.  Also, this is most likely a 16-bit value, which is a sensible
+		// default addressing mode to assume.
+		value = m_context.GetObjectCode().GetPC();
+	}
+	else if ( HasAddressingMode( instruction, REL ) && m_context.GetGlobalData().IsFirstPass() )
 	{
-		value = EvaluateExpressionAsInt();
-		
 		// If this is relative addressing and we're on the first pass, we don't
 		// use the value we just calculated. This is because we may have
 		// successfully evaluated the expression but obtained the wrong value
@@ -735,24 +766,7 @@ void LineParser::HandleAssembler( int instruction )
 		// there's an earlier definition in an outer scope - value would evaluate
 		// successfully to use the wrong label, and we might get a spurious branch
 		// out of range error. See local-forward-branch-1.6502 for an example.
-		if ( HasAddressingMode( instruction, REL ) && GlobalData::Instance().IsFirstPass() )
-		{
-			value = ObjectCode::Instance().GetPC();
-		}
-	}
-	catch ( AsmException_SyntaxError_SymbolNotDefined& )
-	{
-		if ( GlobalData::Instance().IsFirstPass() )
-		{
-			// this allows branches to assemble when the value is unknown due to a label not having
-			// yet been defined.  Also, this is most likely a 16-bit value, which is a sensible
-			// default addressing mode to assume.
-			value = ObjectCode::Instance().GetPC();
-		}
-		else
-		{
-			throw;
-		}
+		value = m_context.GetObjectCode().GetPC();
 	}
 
 	if ( !AdvanceAndCheckEndOfStatement() )
@@ -763,7 +777,7 @@ void LineParser::HandleAssembler( int instruction )
 
 		if ( HasAddressingMode( instruction, REL ) )
 		{
-			int branchAmount = value - ( ObjectCode::Instance().GetPC() + 2 );
+			int branchAmount = value - ( m_context.GetObjectCode().GetPC() + 2 );
 
 			if ( branchAmount < -128 )
 			{
@@ -0,0 +1,329 @@
+/*************************************************************************************************/
+/**
+	assemblycontext.cpp
+
+	The state of a single assembly
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#include "assemblycontext.h"
+#include "beebasm.h"
+#include "globaldata.h"
+#include "symboltable.h"
+#include "objectcode.h"
+#include "macro.h"
+#include "linecache.h"
+#include "random.h"
+#include "sourcefile.h"
+
+
+using namespace std;
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::AssemblyContext()
+
+	AssemblyContext constructor
+
+	The SymbolNamePool and FileCache must already have been created.
+*/
+/*************************************************************************************************/
+AssemblyContext::AssemblyContext()
+	:	m_globalData( new GlobalData ),
+		m_symbolTable( new SymbolTable( *this ) ),
+		m_objectCode( new ObjectCode( *this ) ),
+		m_macroTable( new MacroTable ),
+		m_lineCacheTable( new LineCacheTable ),
+		m_random( new RandomGenerator ),
+		m_pOutput( &cout ),
+		m_pErrors( &cerr ),
+		m_pFileProvider( NULL ),
+		m_pSavedFiles( NULL ),
+		m_pFilesRead( NULL ),
+		m_bRepeatable( true )
+{
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::~AssemblyContext()
+
+	AssemblyContext destructor
+*/
+/*************************************************************************************************/
+AssemblyContext::~AssemblyContext()
+{
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::SetOutput()
+
+	Redirects the output of the assembly
+
+	@param		output			Stream for the listing and PRINT output
+	@param		errors			Stream for messages and errors
+*/
+/*************************************************************************************************/
+void AssemblyContext::SetOutput( ostream& output, ostream& errors )
+{
+	m_pOutput = &output;
+	m_pErrors = &errors;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::SetFileProvider()
+
+	Has the files read by the assembly supplied by the embedding program, rather than read from
+	disc
+
+	@param		pFileProvider	The file provider, or NULL to read from disc
+*/
+/*************************************************************************************************/
+void AssemblyContext::SetFileProvider( BeebAsm::FileProvider* pFileProvider )
+{
+	m_pFileProvider = pFileProvider;
+	m_providedFiles.clear();
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::FindProvidedFile()
+
+	Asks the file provider for a file, the first time it's needed
+
+	@param		filename		The file
+	@returns	ProvidedFile&	What the provider supplied
+*/
+/*************************************************************************************************/
+AssemblyContext::ProvidedFile& AssemblyContext::FindProvidedFile( const string& filename )
+{
+	map< string, ProvidedFile >::iterator it = m_providedFiles.find( filename );
+
+	if ( it == m_providedFiles.end() )
+	{
+		it = m_providedFiles.insert( make_pair( filename, ProvidedFile() ) ).first;
+
+		string contents;
+
+		if ( m_pFileProvider->ReadFile( filename, contents ) )
+		{
+			it->second.m_contents = make_shared< const string >( move( contents ) );
+		}
+	}
+
+	return it->second;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::GetFile()
+
+	Gets the contents of a file
+
+	@param		filename		The file
+	@returns	FileContents	Its contents, or null if it couldn't be read
+*/
+/*************************************************************************************************/
+FileContents AssemblyContext::GetFile( const string& filename )
+{
+	if ( m_pFileProvider == NULL )
+	{
+		FileContents contents = FileCache::Instance().GetFile( filename );
+		NoteFileRead( filename, false, contents );
+		return contents;
+	}
+
+	return FindProvidedFile( filename ).m_contents;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::GetSourceText()
+
+	Gets the contents of a source file, normalised by FileCache::NormaliseSource()
+
+	@param		filename		The file
+	@returns	FileContents	Its text, or null if it couldn't be read
+*/
+/*************************************************************************************************/
+FileContents AssemblyContext::GetSourceText( const string& filename )
+{
+	if ( m_pFileProvider == NULL )
+	{
+		FileContents text = FileCache::Instance().GetSourceText( filename );
+		NoteFileRead( filename, true, text );
+		return text;
+	}
+
+	ProvidedFile& file = FindProvidedFile( filename );
+
+	if ( file.m_contents && !file.m_sourceText )
+	{
+		file.m_sourceText = make_shared< const string >( FileCache::NormaliseSource( *file.m_contents ) );
+	}
+
+	return file.m_sourceText;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::NoteFileRead()
+
+	Notes what was first read from a file, if the files read are being noted.  If a source file
+	is also read as it is, by INCBIN or PUTTEXT say, its raw contents are noted instead, as
+	they cover everything it was used for.
+
+	@param		filename		The file
+	@param		isSource		Whether it was read as source text
+	@param		contents		What was read, or null if it couldn't be
+*/
+/*************************************************************************************************/
+void AssemblyContext::NoteFileRead( const string& filename, bool isSource, const FileContents& contents )
+{
+	if ( m_pFilesRead == NULL )
+	{
+		return;
+	}
+
+	FilesRead::iterator it = m_pFilesRead->find( filename );
+
+	if ( it == m_pFilesRead->end() || ( it->second.m_isSource && !isSource ) )
+	{
+		FileRead& fileRead = ( *m_pFilesRead )[ filename ];
+		fileRead.m_isSource = isSource;
+		fileRead.m_contents = contents;
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::NoteFileWritten()
+
+	Notes that the assembly has written a file
+
+	@param		filename		The file
+*/
+/*************************************************************************************************/
+void AssemblyContext::NoteFileWritten( const string& filename )
+{
+	if ( find( m_filesWritten.begin(), m_filesWritten.end(), filename ) == m_filesWritten.end() )
+	{
+		m_filesWritten.push_back( filename );
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::TakeLineCaches()
+
+	Takes over the line caches of an earlier assembly, so that the lines of any files which haven't
+	changed since don't need lexing again, nor their expressions compiling again
+
+	@param		previous		The earlier assembly, which is left with no cached lines
+*/
+/*************************************************************************************************/
+void AssemblyContext::TakeLineCaches( AssemblyContext& previous )
+{
+	m_lineCacheTable.swap( previous.m_lineCacheTable );
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::KeepSavedFile()
+
+	Keeps a copy of a file saved by the assembly, for the embedding program
+
+	@param		filename		Filename it was saved as
+	@param		data			Its contents
+	@param		load			Load address
+	@param		exec			Execution address
+	@param		length			Length in bytes
+*/
+/*************************************************************************************************/
+void AssemblyContext::KeepSavedFile( const string& filename,
+									 const unsigned char* data,
+									 int load,
+									 int exec,
+									 size_t length )
+{
+	assert( m_pSavedFiles != NULL );
+
+	BeebAsm::SavedFile file;
+	file.m_filename = filename;
+	file.m_loadAddress = load;
+	file.m_execAddress = exec;
+	file.m_data.assign( data, data + length );
+
+	m_pSavedFiles->push_back( file );
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssemblyContext::Assemble()
+
+	Assembles a source file, making both passes over it
+
+	@param		filename		The main source file
+	@param		randomSeed		Seed for RND(), which is the same for both passes
+
+	If there is a problem, an AsmException will be thrown.
+*/
+/*************************************************************************************************/
+void AssemblyContext::Assemble( const string& filename, unsigned long randomSeed )
+{
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		m_globalData->SetPass( pass );
+		m_objectCode->InitialisePass();
+		m_globalData->ResetForId();
+		m_random->Seed( randomSeed, false );
+		SourceFile input( *this, filename, 0 );
+		input.Process();
+	}
+}
@@ -0,0 +1,153 @@
+/*************************************************************************************************/
+/**
+	assemblycontext.h
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#ifndef ASSEMBLYCONTEXT_H_
+#define ASSEMBLYCONTEXT_H_
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "filecache.h"
+
+
+class GlobalData;
+class SymbolTable;
+class ObjectCode;
+class MacroTable;
+class LineCacheTable;
+class RandomGenerator;
+
+namespace BeebAsm
+{
+	class FileProvider;
+	struct SavedFile;
+}
+
+
+// Everything belonging to a single assembly: its options, symbols, macros, object code and
+// lexed source.  It's handed to every SourceCode and LineParser, so any number of assemblies can
+// run at once, each on its own thread.  The only state they share is the SymbolNamePool and the
+// FileCache, which are safe to use from several threads.
+class AssemblyContext
+{
+public:
+
+	AssemblyContext();
+	~AssemblyContext();
+
+	inline GlobalData&		GetGlobalData()		{ return *m_globalData; }
+	inline SymbolTable&		GetSymbolTable()	{ return *m_symbolTable; }
+	inline ObjectCode&		GetObjectCode()		{ return *m_objectCode; }
+	inline MacroTable&		GetMacroTable()		{ return *m_macroTable; }
+	inline LineCacheTable&	GetLineCacheTable()	{ return *m_lineCacheTable; }
+	inline RandomGenerator&	GetRandom()			{ return *m_random; }
+
+	// Where the listing and PRINT output, and messages and errors, are written; stdout and stderr
+	// unless the output of concurrent assemblies is being kept apart
+	inline std::ostream&	GetOutput()			{ return *m_pOutput; }
+	inline std::ostream&	GetErrors()			{ return *m_pErrors; }
+	void					SetOutput( std::ostream& output, std::ostream& errors );
+
+	// Files are read from the FileCache, unless they're being supplied by the program embedding
+	// the assembler, in which case they're kept here for the duration of the assembly
+	void					SetFileProvider( BeebAsm::FileProvider* pFileProvider );
+	FileContents			GetFile( const std::string& filename );
+	FileContents			GetSourceText( const std::string& filename );
+
+	// Saved files are written to disc, unless they're being kept for the program embedding the
+	// assembler
+	inline void				SetSavedFiles( std::vector< BeebAsm::SavedFile >* pSavedFiles ) { m_pSavedFiles = pSavedFiles; }
+	inline bool				KeepsSavedFiles() const	{ return m_pSavedFiles != NULL; }
+	void					KeepSavedFile( const std::string& filename,
+										   const unsigned char* data,
+										   int load,
+										   int exec,
+										   size_t length );
+
+	// The files read by an assembly, and what was read from them, can be noted so that they
+	// can be watched for changes
+	struct FileRead
+	{
+		bool			m_isSource;
+		FileContents	m_contents;			// null if it couldn't be read
+	};
+
+	typedef std::map< std::string, FileRead > FilesRead;
+
+	inline void				SetFilesRead( FilesRead* pFilesRead ) { m_pFilesRead = pFilesRead; }
+	inline FilesRead*		GetFilesRead() const	{ return m_pFilesRead; }
+
+	// The files written by SAVE, in the order they were first written
+	void					NoteFileWritten( const std::string& filename );
+	inline const std::vector< std::string >& GetFilesWritten() const { return m_filesWritten; }
+
+	// Whether assembling the same files in the same way would give the same results; not if they
+	// depend on the time, or on random numbers seeded from it
+	inline void				NoteUnrepeatable()		{ m_bRepeatable = false; }
+	inline bool				IsRepeatable() const	{ return m_bRepeatable; }
+
+	// Reuses the source lines lexed by an earlier assembly of the same files
+	void					TakeLineCaches( AssemblyContext& previous );
+
+	void					Assemble( const std::string& filename, unsigned long randomSeed );
+
+private:
+
+	AssemblyContext( const AssemblyContext& );
+	AssemblyContext& operator=( const AssemblyContext& );
+
+	// In order of construction; the symbol table and object code refer back to the context
+	std::unique_ptr< GlobalData >		m_globalData;
+	std::unique_ptr< SymbolTable >		m_symbolTable;
+	std::unique_ptr< ObjectCode >		m_objectCode;
+	std::unique_ptr< MacroTable >		m_macroTable;
+	std::unique_ptr< LineCacheTable >	m_lineCacheTable;
+	std::unique_ptr< RandomGenerator >	m_random;
+
+	std::ostream*						m_pOutput;
+	std::ostream*						m_pErrors;
+
+	struct ProvidedFile
+	{
+		FileContents	m_contents;			// null if the provider doesn't have it
+		FileContents	m_sourceText;
+	};
+
+	ProvidedFile& FindProvidedFile( const std::string& filename );
+	void NoteFileRead( const std::string& filename, bool isSource, const FileContents& contents );
+
+	BeebAsm::FileProvider*					m_pFileProvider;
+	std::map< std::string, ProvidedFile >	m_providedFiles;
+
+	std::vector< BeebAsm::SavedFile >*		m_pSavedFiles;
+
+	FilesRead*								m_pFilesRead;
+	std::vector< std::string >				m_filesWritten;
+	bool									m_bRepeatable;
+};
+
+
+
+#endif // ASSEMBLYCONTEXT_H_
@@ -31,7 +31,7 @@ struct TokenizeError
 	int lineNumber;
 };
 
-// Read a plain text BBC BASIC program from `file` and write it tokenized to `tokenized`
-TokenizeError tokenize_file(FILE* file, std::vector<unsigned char>& tokenized);
+// Tokenize a plain text BBC BASIC program read into memory from a file, writing it to `tokenized`
+TokenizeError tokenize_file(const char* data, size_t length, std::vector<unsigned char>& tokenized);
 
 #endif // TOKENIZE_H_
@@ -0,0 +1,294 @@
+/*************************************************************************************************/
+/**
+	beebasm.cpp
+
+	libbeebasm: assembles in memory, for a program embedding the assembler
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#include <ctime>
+#include <sstream>
+
+#include "beebasm.h"
+#include "assemblycontext.h"
+#include "asmexception.h"
+#include "filecache.h"
+#include "globaldata.h"
+#include "objectcode.h"
+#include "symbolnamepool.h"
+#include "symboltable.h"
+
+
+using namespace std;
+
+
+
+namespace BeebAsm
+{
+
+/*************************************************************************************************/
+/**
+	TextFileProvider
+
+	Supplies the source text given to AssembleText() as the main source file, and any other
+	files from the embedding program's file provider, or from disc
+*/
+/*************************************************************************************************/
+class TextFileProvider : public FileProvider
+{
+public:
+
+	TextFileProvider( const string& filename, const string& text, FileProvider* pFileProvider )
+		:	m_filename( filename ),
+			m_text( text ),
+			m_pFileProvider( pFileProvider )
+	{
+	}
+
+	virtual bool ReadFile( const string& filename, string& contents )
+	{
+		if ( filename == m_filename )
+		{
+			contents = m_text;
+			return true;
+		}
+
+		if ( m_pFileProvider != NULL )
+		{
+			return m_pFileProvider->ReadFile( filename, contents );
+		}
+
+		FileContents file = FileCache::Instance().GetFile( filename );
+
+		if ( !file )
+		{
+			return false;
+		}
+
+		contents = *file;
+		return true;
+	}
+
+private:
+
+	const string&	m_filename;
+	const string&	m_text;
+	FileProvider*	m_pFileProvider;
+};
+
+
+
+/*************************************************************************************************/
+/**
+	AddDiagnostic()
+
+	Adds an error or warning to the result of an assembly
+
+	@param		result			The result
+	@param		severity		Whether it's an error or a warning
+	@param		message			The message
+	@returns	Diagnostic&		The diagnostic, whose location can be filled in
+*/
+/*************************************************************************************************/
+static Diagnostic& AddDiagnostic( Result& result, Diagnostic::Severity severity, const string& message )
+{
+	Diagnostic diagnostic;
+	diagnostic.m_severity = severity;
+	diagnostic.m_lineNumber = 0;
+	diagnostic.m_column = 0;
+	diagnostic.m_message = message;
+
+	result.m_diagnostics.push_back( diagnostic );
+	return result.m_diagnostics.back();
+}
+
+
+
+/*************************************************************************************************/
+/**
+	Initialise()
+
+	Creates the state shared by every assembly
+*/
+/*************************************************************************************************/
+void Initialise()
+{
+	SymbolNamePool::Create();
+	FileCache::Create();
+}
+
+
+
+/*************************************************************************************************/
+/**
+	Shutdown()
+
+	Destroys the state shared by every assembly
+*/
+/*************************************************************************************************/
+void Shutdown()
+{
+	FileCache::Destroy();
+	SymbolNamePool::Destroy();
+}
+
+
+
+/*************************************************************************************************/
+/**
+	Assemble()
+
+	Assembles a source file in memory
+
+	@param		options			What to assemble, and how
+	@param		result			Receives the results of the assembly
+	@param		pFileProvider	Supplies the files read, or NULL to read them from disc
+	@returns	bool			Whether the assembly succeeded
+*/
+/*************************************************************************************************/
+bool Assemble( const Options& options, Result& result, FileProvider* pFileProvider )
+{
+	result.m_succeeded = false;
+	result.m_memory.clear();
+	result.m_savedFiles.clear();
+	result.m_symbols.clear();
+	result.m_diagnostics.clear();
+
+	ostringstream output;
+	ostringstream messages;
+
+	AssemblyContext context;
+	context.SetOutput( output, messages );
+	context.SetFileProvider( pFileProvider );
+	context.SetSavedFiles( &result.m_savedFiles );
+
+	GlobalData& globalData = context.GetGlobalData();
+
+	if ( options.m_verbose )
+	{
+		globalData.SetVerbose( true );
+	}
+
+	globalData.SetRequireDistinctOpcodes( options.m_requireDistinctOpcodes );
+	globalData.SetUseVisualCppErrorFormat( options.m_useVisualCppErrorFormat );
+
+	if ( !options.m_outputFile.empty() )
+	{
+		globalData.SetOutputFile( options.m_outputFile.c_str() );
+	}
+
+	bool ok = true;
+
+	for ( vector< string >::const_iterator it = options.m_symbols.begin(); it != options.m_symbols.end(); ++it )
+	{
+		if ( !context.GetSymbolTable().AddCommandLineSymbol( *it ) )
+		{
+			AddDiagnostic( result, Diagnostic::SEVERITY_ERROR, "Invalid -D expression: " + *it );
+			messages << "Invalid -D expression: " << *it << endl;
+			ok = false;
+		}
+	}
+
+	for ( vector< string >::const_iterator it = options.m_stringSymbols.begin(); it != options.m_stringSymbols.end(); ++it )
+	{
+		if ( !context.GetSymbolTable().AddCommandLineStringSymbol( *it ) )
+		{
+			AddDiagnostic( result, Diagnostic::SEVERITY_ERROR, "Invalid -S expression: " + *it );
+			messages << "Invalid -S expression: " << *it << endl;
+			ok = false;
+		}
+	}
+
+	if ( ok )
+	{
+		try
+		{
+			context.Assemble( options.m_inputFile, static_cast< unsigned long >( time( NULL ) ) );
+		}
+		catch ( AsmException_SyntaxError& e )
+		{
+			e.Print( messages, options.m_useVisualCppErrorFormat );
+
+			Diagnostic& diagnostic = AddDiagnostic( result, Diagnostic::SEVERITY_ERROR, string( e.Message() ) + e.GetExtra() );
+			diagnostic.m_filename = e.GetFilename();
+			diagnostic.m_lineNumber = e.GetLineNumber();
+			diagnostic.m_column = e.GetColumn();
+			diagnostic.m_line = e.GetLine();
+			ok = false;
+		}
+		catch ( AsmException_FileError& e )
+		{
+			e.Print( messages, options.m_useVisualCppErrorFormat );
+
+			Diagnostic& diagnostic = AddDiagnostic( result, Diagnostic::SEVERITY_ERROR, e.Message() );
+			diagnostic.m_filename = e.GetFilename();
+			ok = false;
+		}
+		catch ( AsmException& e )
+		{
+			ostringstream message;
+			e.Print( message, options.m_useVisualCppErrorFormat );
+			messages << message.str();
+
+			AddDiagnostic( result, Diagnostic::SEVERITY_ERROR, message.str() );
+			ok = false;
+		}
+	}
+
+	if ( ok && !globalData.IsSaved() && context.GetObjectCode().AnyUsed() )
+	{
+		AddDiagnostic( result, Diagnostic::SEVERITY_WARNING, "no SAVE command in source file." );
+		messages << "warning: no SAVE command in source file." << endl;
+	}
+
+	const unsigned char* pMemory = context.GetObjectCode().GetAddr( 0 );
+	result.m_memory.assign( pMemory, pMemory + 0x10000 );
+
+	context.GetSymbolTable().GetTopLevelSymbols( result.m_symbols );
+
+	result.m_succeeded = ok;
+	result.m_output = output.str();
+	result.m_messages = messages.str();
+
+	return ok;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssembleText()
+
+	Assembles source text in memory
+
+	@param		text			The source text, which is given the name options.m_inputFile
+	@param		options			How to assemble it
+	@param		result			Receives the results of the assembly
+	@param		pFileProvider	Supplies any other files read, or NULL to read them from disc
+	@returns	bool			Whether the assembly succeeded
+*/
+/*************************************************************************************************/
+bool AssembleText( const string& text, const Options& options, Result& result, FileProvider* pFileProvider )
+{
+	TextFileProvider fileProvider( options.m_inputFile, text, pFileProvider );
+
+	return Assemble( options, result, &fileProvider );
+}
+
+}
@@ -0,0 +1,138 @@
+/*************************************************************************************************/
+/**
+	beebasm.h
+
+	The interface of libbeebasm, for assembling from within another program
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#ifndef BEEBASM_H_
+#define BEEBASM_H_
+
+#include <string>
+#include <vector>
+
+
+// An assembly run through the library reads its files through a FileProvider if one is given,
+// and otherwise from disc.  It writes no files: everything it produces is returned in a Result.
+// Any number of assemblies can be run at once on different threads.
+namespace BeebAsm
+{
+	// Supplies the files read by an assembly: its source files, and the files read by INCBIN,
+	// PUTFILE, PUTTEXT and PUTBASIC.  Each file is asked for at most once per assembly.
+	class FileProvider
+	{
+	public:
+
+		virtual ~FileProvider() {}
+
+		// Returns false if there is no such file
+		virtual bool ReadFile( const std::string& filename, std::string& contents ) = 0;
+	};
+
+
+	// The equivalents of the command line options which make sense for an assembly in memory
+	struct Options
+	{
+		Options()
+			:	m_verbose( false ),
+				m_requireDistinctOpcodes( false ),
+				m_useVisualCppErrorFormat( false )
+		{
+		}
+
+		std::string					m_inputFile;				// -i: the main source file
+		std::string					m_outputFile;				// -o: the file saved by SAVE with no filename
+		std::vector< std::string >	m_symbols;					// -D: each "symbol" or "symbol=value"
+		std::vector< std::string >	m_stringSymbols;			// -S: each "symbol=string"
+		bool						m_verbose;					// -v: list the code assembled
+		bool						m_requireDistinctOpcodes;	// -w
+		bool						m_useVisualCppErrorFormat;	// -vc, for the messages
+	};
+
+
+	// A file saved by SAVE, or put on the disc by PUTFILE, PUTTEXT or PUTBASIC
+	struct SavedFile
+	{
+		std::string						m_filename;
+		int								m_loadAddress;
+		int								m_execAddress;
+		std::vector< unsigned char >	m_data;
+	};
+
+
+	// A symbol defined at the top level, including the built-in ones such as PI and P%
+	struct Symbol
+	{
+		std::string						m_name;
+		bool							m_isLabel;
+		bool							m_isString;
+		double							m_number;				// if it isn't a string
+		std::string						m_string;				// if it is
+	};
+
+
+	// An error or warning
+	struct Diagnostic
+	{
+		enum Severity
+		{
+			SEVERITY_WARNING,
+			SEVERITY_ERROR
+		};
+
+		Severity						m_severity;
+		std::string						m_filename;				// empty if not about a file
+		int								m_lineNumber;			// 0 if not about a line
+		int								m_column;
+		std::string						m_message;
+		std::string						m_line;					// the text of the line
+	};
+
+
+	struct Result
+	{
+		bool							m_succeeded;
+		std::vector< unsigned char >	m_memory;				// the 64K memory map after assembly
+		std::vector< SavedFile >		m_savedFiles;
+		std::vector< Symbol >			m_symbols;				// sorted by name
+		std::vector< Diagnostic >		m_diagnostics;
+		std::string						m_output;				// the listing and PRINT output
+		std::string						m_messages;				// the diagnostics as beebasm prints them
+	};
+
+
+	// Must be called once before any assemblies are run, and Shutdown() once after they have
+	// all finished
+	void Initialise();
+	void Shutdown();
+
+	// Assembles options.m_inputFile, reading it (and the files it uses) through the file provider
+	// if there is one.  Returns whether it succeeded.
+	bool Assemble( const Options& options, Result& result, FileProvider* pFileProvider = NULL );
+
+	// Assembles some source text, as if it had been read from options.m_inputFile; any other
+	// files are read through the file provider if there is one
+	bool AssembleText( const std::string& text, const Options& options, Result& result,
+					   FileProvider* pFileProvider = NULL );
+}
+
+
+
+#endif // BEEBASM_H_
@@ -0,0 +1,527 @@
+/*************************************************************************************************/
+/**
+	buildcache.cpp
+
+	Keeps the results of assemblies, to be restored when an assembly is repeated
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include "buildcache.h"
+#include "filecache.h"
+#include "outputfile.h"
+#include "sha256.h"
+
+
+using namespace std;
+
+
+// The number of assemblies remembered for each command line
+static const size_t MAX_MANIFEST_ENTRIES = 16;
+
+
+
+/*************************************************************************************************/
+/**
+	ReadWholeFile()
+
+	Reads a file straight from disc, bypassing the file cache, which is only for files read by
+	assemblies
+
+	@param		filename		The file
+	@param		contents		Receives its contents
+	@returns	bool			false if it couldn't be read
+*/
+/*************************************************************************************************/
+static bool ReadWholeFile( const string& filename, string& contents )
+{
+	ifstream stream( filename.c_str(), ios_base::in | ios_base::binary );
+
+	if ( !stream )
+	{
+		return false;
+	}
+
+	ostringstream buffer;
+	buffer << stream.rdbuf();
+
+	if ( stream.bad() )
+	{
+		return false;
+	}
+
+	contents = buffer.str();
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::HashData()
+
+	Hashes some data with SHA-256
+
+	@param		data			The data
+	@param		length			Its length in bytes
+	@param		previous		The hash of any data it follows, or empty
+	@returns	Hash			The hash
+*/
+/*************************************************************************************************/
+BuildCache::Hash BuildCache::HashData( const char* data, size_t length, const Hash& previous )
+{
+	Sha256 sha;
+	sha.Update( previous );
+	sha.Update( data, length );
+	return sha.HexDigest();
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::IsHash()
+
+	Whether some text read from a manifest is a hash
+*/
+/*************************************************************************************************/
+bool BuildCache::IsHash( const string& text )
+{
+	return text.length() == 64 && text.find_first_not_of( "0123456789abcdef" ) == string::npos;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::BuildCache()
+
+	BuildCache constructor
+
+	@param		directory		The directory holding the cache, which must already exist
+*/
+/*************************************************************************************************/
+BuildCache::BuildCache( const string& directory )
+	:	m_directory( directory )
+{
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::ManifestFilename()
+*/
+/*************************************************************************************************/
+string BuildCache::ManifestFilename( const Hash& commandKey ) const
+{
+	return m_directory + "/" + commandKey + ".manifest";
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::BlobFilename()
+*/
+/*************************************************************************************************/
+string BuildCache::BlobFilename( const Hash& hash ) const
+{
+	return m_directory + "/" + hash + ".blob";
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::ReadManifest()
+
+	Reads the assemblies remembered for a command line, most recent first.  A manifest which can't
+	be read, or doesn't make sense, is treated as empty.
+
+	@param		commandKey		Hash of the command line
+	@param		entries			Receives the assemblies
+*/
+/*************************************************************************************************/
+void BuildCache::ReadManifest( const Hash& commandKey, vector< Entry >& entries ) const
+{
+	entries.clear();
+
+	ifstream manifest( ManifestFilename( commandKey ).c_str() );
+	string line;
+
+	while ( getline( manifest, line ) )
+	{
+		istringstream fields( line );
+		string type;
+		fields >> type;
+
+		if ( type == "entry" )
+		{
+			Entry entry;
+			fields >> entry.m_outputHash >> entry.m_errorsHash;
+
+			if ( !fields || !IsHash( entry.m_outputHash ) || !IsHash( entry.m_errorsHash ) )
+			{
+				break;
+			}
+
+			entries.push_back( entry );
+			continue;
+		}
+
+		if ( entries.empty() )
+		{
+			break;
+		}
+
+		if ( type == "input" )
+		{
+			Input input;
+			string kind;
+			fields >> kind >> input.m_hash;
+			fields.get();
+
+			if ( !fields || !IsHash( input.m_hash ) || !getline( fields, input.m_filename ) )
+			{
+				break;
+			}
+
+			input.m_isSource = ( kind == "S" );
+			entries.back().m_inputs.push_back( input );
+		}
+		else if ( type == "output" )
+		{
+			Output output;
+			fields >> output.m_hash;
+			fields.get();
+
+			if ( !fields || !IsHash( output.m_hash ) || !getline( fields, output.m_filename ) )
+			{
+				break;
+			}
+
+			entries.back().m_outputs.push_back( output );
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::ReadBlob()
+*/
+/*************************************************************************************************/
+bool BuildCache::ReadBlob( const Hash& hash, string& contents ) const
+{
+	return ReadWholeFile( BlobFilename( hash ), contents ) && HashString( contents ) == hash;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::WriteBlob()
+*/
+/*************************************************************************************************/
+void BuildCache::WriteBlob( const Hash& hash, const string& contents ) const
+{
+	string existing;
+
+	if ( !ReadBlob( hash, existing ) )
+	{
+		WriteFileAtomically( BlobFilename( hash ), contents );
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::WriteFileAtomically()
+
+	Writes a file in the cache under a temporary name and then renames it, so that other
+	assemblies sharing the cache never see it half written
+
+	@param		filename		The file
+	@param		contents		Its contents
+	@returns	bool			false if it couldn't be written
+*/
+/*************************************************************************************************/
+bool BuildCache::WriteFileAtomically( const string& filename, const string& contents ) const
+{
+	static atomic< unsigned int > counter( 0 );
+
+	// The temporary name only has to differ from those used by other threads and processes at the
+	// same time; the address of the counter differs between processes on most systems
+	ostringstream unique;
+	unique << hash< thread::id >()( this_thread::get_id() ) << " "
+		   << reinterpret_cast< size_t >( &counter ) << " "
+		   << time( NULL ) << " "
+		   << counter++;
+
+	string tempFilename = filename + "." + HashString( unique.str() ).substr( 0, 16 ) + ".tmp";
+
+	{
+		ofstream stream( tempFilename.c_str(), ios_base::out | ios_base::binary | ios_base::trunc );
+
+		if ( !stream || !stream.write( contents.data(), contents.length() ) )
+		{
+			stream.close();
+			remove( tempFilename.c_str() );
+			return false;
+		}
+	}
+
+	if ( rename( tempFilename.c_str(), filename.c_str() ) != 0 )
+	{
+		// Some platforms won't rename over an existing file
+		remove( filename.c_str() );
+
+		if ( rename( tempFilename.c_str(), filename.c_str() ) != 0 )
+		{
+			remove( tempFilename.c_str() );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::Restore()
+
+	Looks for an earlier assembly made with the same command line which read exactly the same
+	files as are there now, and if there is one, writes out those of the files it wrote which
+	have changed since
+
+	@param		commandKey		Hash of the command line
+	@param		filesRead		Receives the files the earlier assembly read
+	@param		filesWritten	Receives the files it wrote
+	@param		output			Receives its listing and PRINT output
+	@param		errors			Receives its messages
+	@returns	bool			Whether there was such an assembly
+*/
+/*************************************************************************************************/
+bool BuildCache::Restore( const Hash& commandKey,
+						  AssemblyContext::FilesRead& filesRead,
+						  vector< string >& filesWritten,
+						  string& output,
+						  string& errors ) const
+{
+	vector< Entry > entries;
+	ReadManifest( commandKey, entries );
+
+	for ( vector< Entry >::const_iterator entry = entries.begin(); entry != entries.end(); ++entry )
+	{
+		AssemblyContext::FilesRead read;
+		bool same = true;
+
+		for ( vector< Input >::const_iterator it = entry->m_inputs.begin(); it != entry->m_inputs.end() && same; ++it )
+		{
+			FileContents contents = it->m_isSource ? FileCache::Instance().GetSourceText( it->m_filename )
+												   : FileCache::Instance().GetFile( it->m_filename );
+
+			same = ( contents && HashString( *contents ) == it->m_hash );
+
+			read[ it->m_filename ].m_isSource = it->m_isSource;
+			read[ it->m_filename ].m_contents = contents;
+		}
+
+		if ( !same ||
+			 !ReadBlob( entry->m_outputHash, output ) ||
+			 !ReadBlob( entry->m_errorsHash, errors ) )
+		{
+			continue;
+		}
+
+		// Read all of the files written before writing any of them, in case one has gone
+
+		vector< string > contents( entry->m_outputs.size() );
+
+		for ( size_t i = 0; i < entry->m_outputs.size() && same; i++ )
+		{
+			same = ReadBlob( entry->m_outputs[ i ].m_hash, contents[ i ] );
+		}
+
+		if ( !same )
+		{
+			continue;
+		}
+
+		filesWritten.clear();
+
+		for ( size_t i = 0; i < entry->m_outputs.size(); i++ )
+		{
+			const string& filename = entry->m_outputs[ i ].m_filename;
+			OutputFile::Result result = OutputFile::WriteIfChanged( filename, contents[ i ] );
+
+			if ( result == OutputFile::OPEN_FAILED || result == OutputFile::WRITE_FAILED )
+			{
+				return false;
+			}
+
+			filesWritten.push_back( filename );
+		}
+
+		filesRead.swap( read );
+		return true;
+	}
+
+	return false;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::SameInputs()
+
+	Whether two assemblies read the same files, with the same contents
+*/
+/*************************************************************************************************/
+bool BuildCache::SameInputs( const Entry& entry1, const Entry& entry2 )
+{
+	if ( entry1.m_inputs.size() != entry2.m_inputs.size() )
+	{
+		return false;
+	}
+
+	for ( size_t i = 0; i < entry1.m_inputs.size(); i++ )
+	{
+		if ( entry1.m_inputs[ i ].m_filename != entry2.m_inputs[ i ].m_filename ||
+			 entry1.m_inputs[ i ].m_hash != entry2.m_inputs[ i ].m_hash )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	BuildCache::Store()
+
+	Remembers an assembly, and the files it wrote.  Any problem writing to the cache just means
+	that the assembly isn't remembered.
+
+	@param		commandKey		Hash of the command line
+	@param		filesRead		The files the assembly read
+	@param		filesWritten	The files it wrote, which are read back from disc
+	@param		output			Its listing and PRINT output
+	@param		errors			Its messages
+	@returns	bool			false if the cache couldn't be written to
+*/
+/*************************************************************************************************/
+bool BuildCache::Store( const Hash& commandKey,
+						const AssemblyContext::FilesRead& filesRead,
+						const vector< string >& filesWritten,
+						const string& output,
+						const string& errors ) const
+{
+	Entry entry;
+	entry.m_outputHash = HashString( output );
+	entry.m_errorsHash = HashString( errors );
+
+	for ( AssemblyContext::FilesRead::const_iterator it = filesRead.begin(); it != filesRead.end(); ++it )
+	{
+		if ( !it->second.m_contents )
+		{
+			return true;
+		}
+
+		Input input;
+		input.m_filename = it->first;
+		input.m_isSource = it->second.m_isSource;
+		input.m_hash = HashString( *it->second.m_contents );
+		entry.m_inputs.push_back( input );
+	}
+
+	for ( vector< string >::const_iterator it = filesWritten.begin(); it != filesWritten.end(); ++it )
+	{
+		string contents;
+
+		if ( !ReadWholeFile( *it, contents ) )
+		{
+			return true;
+		}
+
+		Output outputFile;
+		outputFile.m_filename = *it;
+		outputFile.m_hash = HashString( contents );
+		entry.m_outputs.push_back( outputFile );
+
+		WriteBlob( outputFile.m_hash, contents );
+	}
+
+	WriteBlob( entry.m_outputHash, output );
+	WriteBlob( entry.m_errorsHash, errors );
+
+	// The new assembly goes first, followed by those already remembered which read different files
+
+	vector< Entry > entries;
+	ReadManifest( commandKey, entries );
+
+	ostringstream manifest;
+	size_t count = 0;
+
+	entries.insert( entries.begin(), entry );
+
+	for ( vector< Entry >::const_iterator it = entries.begin(); it != entries.end() && count < MAX_MANIFEST_ENTRIES; ++it )
+	{
+		if ( it != entries.begin() && SameInputs( *it, entry ) )
+		{
+			continue;
+		}
+
+		manifest << "entry " << it->m_outputHash << " " << it->m_errorsHash << "\n";
+
+		for ( vector< Input >::const_iterator input = it->m_inputs.begin(); input != it->m_inputs.end(); ++input )
+		{
+			manifest << "input " << ( input->m_isSource ? "S " : "B " ) << input->m_hash << " " << input->m_filename << "\n";
+		}
+
+		for ( vector< Output >::const_iterator outputFile = it->m_outputs.begin(); outputFile != it->m_outputs.end(); ++outputFile )
+		{
+			manifest << "output " << outputFile->m_hash << " " << outputFile->m_filename << "\n";
+		}
+
+		count++;
+	}
+
+	return WriteFileAtomically( ManifestFilename( commandKey ), manifest.str() );
+}
@@ -0,0 +1,107 @@
+/*************************************************************************************************/
+/**
+	buildcache.h
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#ifndef BUILDCACHE_H_
+#define BUILDCACHE_H_
+
+#include <string>
+#include <vector>
+
+#include "assemblycontext.h"
+
+
+// A directory holding the results of earlier assemblies, so that an assembly can be skipped
+// altogether if it's been done before with the same command line and the same files.
+//
+// Everything is addressed by SHA-256 hashes, so that an assembly sharing the cache with many
+// others can't mistake another's outputs for its own.  For each command line there's a manifest
+// listing the recent assemblies made with it: the files each read, with hashes of what was read,
+// and the files each wrote, with hashes of what was written.  The contents of the files written,
+// and the text output, are kept in blobs named by their hashes, so are shared between assemblies.
+class BuildCache
+{
+public:
+
+	// A SHA-256 hash, as 64 hex digits
+	typedef std::string Hash;
+
+	static Hash HashData( const char* data, size_t length, const Hash& previous = Hash() );
+	static inline Hash HashString( const std::string& text, const Hash& previous = Hash() )
+	{
+		// Hash the terminator too, so that consecutive strings can't run into each other
+		return HashData( text.c_str(), text.length() + 1, previous );
+	}
+
+	explicit BuildCache( const std::string& directory );
+
+	bool Restore( const Hash& commandKey,
+				  AssemblyContext::FilesRead& filesRead,
+				  std::vector< std::string >& filesWritten,
+				  std::string& output,
+				  std::string& errors ) const;
+
+	bool Store( const Hash& commandKey,
+				const AssemblyContext::FilesRead& filesRead,
+				const std::vector< std::string >& filesWritten,
+				const std::string& output,
+				const std::string& errors ) const;
+
+private:
+
+	struct Input
+	{
+		std::string		m_filename;
+		bool			m_isSource;
+		Hash			m_hash;
+	};
+
+	struct Output
+	{
+		std::string		m_filename;
+		Hash			m_hash;
+	};
+
+	struct Entry
+	{
+		Hash					m_outputHash;
+		Hash					m_errorsHash;
+		std::vector< Input >	m_inputs;
+		std::vector< Output >	m_outputs;
+	};
+
+	static bool IsHash( const std::string& text );
+	static bool SameInputs( const Entry& entry1, const Entry& entry2 );
+
+	std::string ManifestFilename( const Hash& commandKey ) const;
+	std::string BlobFilename( const Hash& hash ) const;
+
+	void ReadManifest( const Hash& commandKey, std::vector< Entry >& entries ) const;
+	bool ReadBlob( const Hash& hash, std::string& contents ) const;
+	void WriteBlob( const Hash& hash, const std::string& contents ) const;
+	bool WriteFileAtomically( const std::string& filename, const std::string& contents ) const;
+
+	std::string		m_directory;
+};
+
+
+
+#endif // BUILDCACHE_H_
@@ -32,6 +32,7 @@
 #include <climits>
 
 #include "lineparser.h"
+#include "assemblycontext.h"
 #include "globaldata.h"
 #include "objectcode.h"
 #include "stringutils.h"
@@ -39,6 +40,8 @@
 #include "sourcefile.h"
 #include "asmexception.h"
 #include "discimage.h"
+#include "filecache.h"
+#include "outputfile.h"
 #include "basic_tokenize.h"
 #include "random.h"
 
@@ -64,6 +67,7 @@ const LineParser::Token	LineParser::m_gaTokenTable[] =
 	{ N("EQUW"),		&LineParser::HandleEquw,				0 },
 	{ N("ASSERT"),		&LineParser::HandleAssert,				0 },
 	{ N("SAVE"),		&LineParser::HandleSave,				0 },
+	{ N("LOADORDER"),	&LineParser::HandleLoadOrder,			0 },
 	{ N("FOR"),			&LineParser::HandleFor,					0 },
 	{ N("NEXT"),		&LineParser::HandleNext,				0 },
 	{ N("IF"),			&LineParser::HandleIf,					&SourceFile::AddIfLevel },
@@ -93,6 +97,52 @@ const LineParser::Token	LineParser::m_gaTokenTable[] =
 
 #undef N
 
+const LineParser::TokenIndex LineParser::m_gTokenIndex;
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::TokenIndex::TokenIndex()
+
+	Builds the index of the token table by first character
+*/
+/*************************************************************************************************/
+LineParser::TokenIndex::TokenIndex()
+{
+	const int tokenCount = static_cast<int>( sizeof m_gaTokenTable / sizeof( Token ) );
+
+	// Count the tokens starting with each character, and turn the counts into start positions
+
+	size_t count[ 256 ] = { 0 };
+
+	for ( int i = 0; i < tokenCount; i++ )
+	{
+		count[ static_cast< unsigned char >( m_gaTokenTable[ i ].m_pName[ 0 ] ) ]++;
+	}
+
+	m_start[ 0 ] = 0;
+	for ( int c = 0; c < 256; c++ )
+	{
+		m_start[ c + 1 ] = m_start[ c ] + count[ c ];
+	}
+
+	// Place the tokens, keeping them in table order within each character
+
+	m_tokens.resize( tokenCount );
+
+	size_t next[ 256 ];
+	for ( int c = 0; c < 256; c++ )
+	{
+		next[ c ] = m_start[ c ];
+	}
+
+	for ( int i = 0; i < tokenCount; i++ )
+	{
+		m_tokens[ next[ static_cast< unsigned char >( m_gaTokenTable[ i ].m_pName[ 0 ] ) ]++ ] = i;
+	}
+}
+
 
 
 /*************************************************************************************************/
@@ -111,20 +161,27 @@ const LineParser::Token	LineParser::m_gaTokenTable[] =
 /*************************************************************************************************/
 int LineParser::GetTokenAndAdvanceColumn()
 {
+	if ( m_column >= m_line.length() )
+	{
+		return -1;
+	}
+
 	size_t remaining = m_line.length() - m_column;
+	unsigned char first = static_cast< unsigned char >( Ascii::ToUpper( m_line[ m_column ] ) );
 
-	for ( int i = 0; i < static_cast<int>( sizeof m_gaTokenTable / sizeof( Token ) ); i++ )
+	for ( size_t k = m_gTokenIndex.m_start[ first ]; k < m_gTokenIndex.m_start[ first + 1 ]; k++ )
 	{
+		int			i		= m_gTokenIndex.m_tokens[ k ];
 		const char*	token	= m_gaTokenTable[ i ].m_pName;
 		size_t		len		= m_gaTokenTable[ i ].m_nameLength;
 		assert( len == strlen( token ) );
 
 		if (len <= remaining)
 		{
-			// see if token matches
+			// see if the rest of the token matches
 
 			bool bMatch = true;
-			for ( unsigned int j = 0; j < len; j++ )
+			for ( unsigned int j = 1; j < len; j++ )
 			{
 				if ( token[ j ] != Ascii::ToUpper( m_line[ m_column + j ] ) )
 				{
@@ -394,18 +451,9 @@ private:
 			m_paramColumn = m_lineParser.m_column;
 			if (found)
 			{
-				try
-				{
-					m_pendingUndefined = false;
-					m_pendingValue = m_lineParser.EvaluateExpression();
-				}
-				catch ( AsmException_SyntaxError_SymbolNotDefined& )
+				m_pendingUndefined = !m_lineParser.TryEvaluateExpression( m_pendingValue );
+				if ( m_pendingUndefined )
 				{
-					if ( !GlobalData::Instance().IsFirstPass() )
-					{
-						throw;
-					}
-					m_pendingUndefined = true;
 					m_pendingValue = 0;
 				}
 				m_pending = true;
@@ -506,35 +554,35 @@ void LineParser::HandleDefineLabel()
 
 		ScopedSymbolName fullSymbolName = m_sourceCode->GetScopedSymbolName( symbolName, target_level );
 
-		if ( GlobalData::Instance().IsFirstPass() )
+		if ( m_context.GetGlobalData().IsFirstPass() )
 		{
 			// only add the symbol on the first pass
 
-			if ( SymbolTable::Instance().IsSymbolDefined( fullSymbolName ) )
+			if ( m_context.GetSymbolTable().IsSymbolDefined( fullSymbolName ) )
 			{
 				throw AsmException_SyntaxError_LabelAlreadyDefined( m_line, oldColumn );
 			}
 			else
 			{
-				SymbolTable::Instance().AddSymbol( fullSymbolName, ObjectCode::Instance().GetPC(), true );
+				m_context.GetSymbolTable().AddSymbol( fullSymbolName, m_context.GetObjectCode().GetPC(), true );
 			}
 		}
 		else
 		{
 			// on the second pass, check that the label would be assigned the same numeric value
 
-			Value value = SymbolTable::Instance().GetSymbol( fullSymbolName );
-			if ((value.GetType() != Value::NumberValue) || (value.GetNumber() != ObjectCode::Instance().GetPC() ))
+			Value value = m_context.GetSymbolTable().GetSymbol( fullSymbolName );
+			if ((value.GetType() != Value::NumberValue) || (value.GetNumber() != m_context.GetObjectCode().GetPC() ))
 			{
 				throw AsmException_SyntaxError_SecondPassProblem( m_line, oldColumn );
 			}
 
-			SymbolTable::Instance().AddLabel(symbolName);
+			m_context.GetSymbolTable().AddLabel(symbolName);
 		}
 
 		if ( m_sourceCode->ShouldOutputAsm() )
 		{
-			cout << "." << symbolName << endl;
+			m_context.GetOutput() << "." << symbolName << endl;
 		}
 	}
 	else
@@ -598,8 +646,7 @@ void LineParser::HandleOrg()
 	int newPC = args.ParseInt().Range(0, 0xFFFF);
 	args.CheckComplete();
 
-	ObjectCode::Instance().SetPC( newPC );
-	SymbolTable::Instance().ChangeBuiltInSymbol( "P%", newPC );
+	m_context.GetObjectCode().SetPC( newPC );
 }
 
 
@@ -615,7 +662,7 @@ void LineParser::HandleCpu()
 	int newCpu = args.ParseInt().Range(0, 1);
 	args.CheckComplete();
 
-	ObjectCode::Instance().SetCPU( static_cast<CPU_TYPE>(newCpu) );
+	m_context.GetObjectCode().SetCPU( static_cast<CPU_TYPE>(newCpu) );
 }
 
 
@@ -631,7 +678,7 @@ void LineParser::HandleGuard()
 	int val = args.ParseInt().Range(0, 0xFFFF);
 	args.CheckComplete();
 
-	ObjectCode::Instance().SetGuard( val );
+	m_context.GetObjectCode().SetGuard( val );
 }
 
 
@@ -650,7 +697,7 @@ void LineParser::HandleClear()
 
 	args.CheckComplete();
 
-	ObjectCode::Instance().Clear( start, end );
+	m_context.GetObjectCode().Clear( start, end );
 }
 
 
@@ -677,7 +724,7 @@ void LineParser::HandleMapChar()
 		// two parameters
 
 		// do single character remapping
-		ObjectCode::Instance().SetMapping( param1, param2 );
+		m_context.GetObjectCode().SetMapping( param1, param2 );
 	}
 	else
 	{
@@ -691,7 +738,7 @@ void LineParser::HandleMapChar()
 		// remap a block
 		for ( int i = param1; i <= param2; i++ )
 		{
-			ObjectCode::Instance().SetMapping( i, param3 + i - param1 );
+			m_context.GetObjectCode().SetMapping( i, param3 + i - param1 );
 		}
 	}
 }
@@ -713,11 +760,11 @@ void LineParser::HandleAlign()
 		throw AsmException_SyntaxError_BadAlignment( m_line, oldColumn );
 	}
 
-	while ( ( ObjectCode::Instance().GetPC() & ( val - 1 ) ) != 0 )
+	while ( ( m_context.GetObjectCode().GetPC() & ( val - 1 ) ) != 0 )
 	{
 		try
 		{
-			ObjectCode::Instance().PutByte( 0 );
+			m_context.GetObjectCode().PutByte( 0 );
 		}
 		catch ( AsmException_AssembleError& e )
 		{
@@ -753,15 +800,15 @@ void LineParser::HandleSkip()
 
 	if ( m_sourceCode->ShouldOutputAsm() )
 	{
-		cout << uppercase << hex << setfill( '0' ) << "     ";
-		cout << setw(4) << ObjectCode::Instance().GetPC() << endl;
+		m_context.GetOutput() << uppercase << hex << setfill( '0' ) << "     ";
+		m_context.GetOutput() << setw(4) << m_context.GetObjectCode().GetPC() << endl;
 	}
 
 	for ( int i = 0; i < val; i++ )
 	{
 		try
 		{
-			ObjectCode::Instance().PutByte( 0 );
+			m_context.GetObjectCode().PutByte( 0 );
 		}
 		catch ( AsmException_AssembleError& e )
 		{
@@ -791,16 +838,16 @@ void LineParser::HandleSkipTo()
 	IntArg addr = args.ParseInt().Range(0, 0x10000);
 	args.CheckComplete();
 
-	if ( ObjectCode::Instance().GetPC() > addr )
+	if ( m_context.GetObjectCode().GetPC() > addr )
 	{
 		throw AsmException_SyntaxError_BackwardsSkip( m_line, addr.Column() );
 	}
 
-	while ( ObjectCode::Instance().GetPC() < addr )
+	while ( m_context.GetObjectCode().GetPC() < addr )
 	{
 		try
 		{
-			ObjectCode::Instance().PutByte( 0 );
+			m_context.GetObjectCode().PutByte( 0 );
 		}
 		catch ( AsmException_AssembleError& e )
 		{
@@ -830,10 +877,10 @@ void LineParser::HandleInclude()
 
 	if ( m_sourceCode->ShouldOutputAsm() )
 	{
-		cerr << "Including file " << filename << endl;
+		m_context.GetErrors() << "Including file " << filename << endl;
 	}
 
-	SourceFile input( filename.c_str(), m_sourceCode );
+	SourceFile input( m_context, filename.c_str(), m_sourceCode );
 	input.Process();
 
 	if ( AdvanceAndCheckEndOfStatement() )
@@ -855,14 +902,14 @@ void LineParser::HandleIncBin()
 
 	if ( m_sourceCode->ShouldOutputAsm() )
 	{
-		cout << uppercase << hex << setfill( '0' ) << "     ";
-		cout << setw(4) << ObjectCode::Instance().GetPC() << "   ";
+		m_context.GetOutput() << uppercase << hex << setfill( '0' ) << "     ";
+		m_context.GetOutput() << setw(4) << m_context.GetObjectCode().GetPC() << "   ";
 	}
 
 	std::vector<unsigned char> firstFour;
 	try
 	{
-		ObjectCode::Instance().IncBin( filename.c_str(), firstFour );
+		m_context.GetObjectCode().IncBin( filename.c_str(), firstFour );
 	}
 	catch ( AsmException_AssembleError& e )
 	{
@@ -878,22 +925,22 @@ void LineParser::HandleIncBin()
 		{
 			if ( i < 3 )
 			{
-				cout << setw(2) << static_cast<int>(firstFour[i]) << " ";
+				m_context.GetOutput() << setw(2) << static_cast<int>(firstFour[i]) << " ";
 				count += 3;
 			}
 			else if ( i == 3 )
 			{
-				cout << "... ";
+				m_context.GetOutput() << "... ";
 				count += 4;
 			}
 		}
 		while (count < 11)
 		{
-			cout << " ";
+			m_context.GetOutput() << " ";
 			++count;
 		}
-		cout << "INCBIN \"" << filename << '"';
-		cout << endl << nouppercase << dec << setfill( ' ' );
+		m_context.GetOutput() << "INCBIN \"" << filename << '"';
+		m_context.GetOutput() << endl << nouppercase << dec << setfill( ' ' );
 	}
 
 	if ( AdvanceAndCheckEndOfStatement() )
@@ -934,15 +981,15 @@ void LineParser::HandleEqub()
 
 			if ( m_sourceCode->ShouldOutputAsm() )
 			{
-				cout << uppercase << hex << setfill( '0' ) << "     ";
-				cout << setw(4) << ObjectCode::Instance().GetPC() << "   ";
-				cout << setw(2) << ( number & 0xFF );
-				cout << endl << nouppercase << dec << setfill( ' ' );
+				m_context.GetOutput() << uppercase << hex << setfill( '0' ) << "     ";
+				m_context.GetOutput() << setw(4) << m_context.GetObjectCode().GetPC() << "   ";
+				m_context.GetOutput() << setw(2) << ( number & 0xFF );
+				m_context.GetOutput() << endl << nouppercase << dec << setfill( ' ' );
 			}
 
 			try
 			{
-				ObjectCode::Instance().PutByte( number & 0xFF );
+				m_context.GetObjectCode().PutByte( number & 0xFF );
 			}
 			catch ( AsmException_AssembleError& e )
 			{
@@ -979,30 +1026,30 @@ void LineParser::HandleEqus( const String& equs )
 {
 	if ( m_sourceCode->ShouldOutputAsm() )
 	{
-		cout << uppercase << hex << setfill( '0' ) << "     ";
-		cout << setw(4) << ObjectCode::Instance().GetPC() << "   ";
+		m_context.GetOutput() << uppercase << hex << setfill( '0' ) << "     ";
+		m_context.GetOutput() << setw(4) << m_context.GetObjectCode().GetPC() << "   ";
 	}
 
 	for ( size_t i = 0; i < equs.Length(); i++ )
 	{
-		int mappedchar = ObjectCode::Instance().GetMapping( equs[ i ] );
+		int mappedchar = m_context.GetObjectCode().GetMapping( equs[ i ] );
 
 		if ( m_sourceCode->ShouldOutputAsm() )
 		{
 			if ( i < 3 )
 			{
-				cout << setw(2) << mappedchar << " ";
+				m_context.GetOutput() << setw(2) << mappedchar << " ";
 			}
 			else if ( i == 3 )
 			{
-				cout << "...";
+				m_context.GetOutput() << "...";
 			}
 		}
 
 		try
 		{
 			// remap character from string as per character mapping table
-			ObjectCode::Instance().PutByte( mappedchar );
+			m_context.GetObjectCode().PutByte( mappedchar );
 		}
 		catch ( AsmException_AssembleError& e )
 		{
@@ -1014,7 +1061,7 @@ void LineParser::HandleEqus( const String& equs )
 
 	if ( m_sourceCode->ShouldOutputAsm() )
 	{
-		cout << endl << nouppercase << dec << setfill( ' ' );
+		m_context.GetOutput() << endl << nouppercase << dec << setfill( ' ' );
 	}
 }
 
@@ -1035,17 +1082,17 @@ void LineParser::HandleEquw()
 	{
 		if ( m_sourceCode->ShouldOutputAsm() )
 		{
-			cout << uppercase << hex << setfill( '0' ) << "     ";
-			cout << setw(4) << ObjectCode::Instance().GetPC() << "   ";
-			cout << setw(2) << ( value & 0xFF ) << " ";
-			cout << setw(2) << ( ( value & 0xFF00 ) >> 8 );
-			cout << endl << nouppercase << dec << setfill( ' ' );
+			m_context.GetOutput() << uppercase << hex << setfill( '0' ) << "     ";
+			m_context.GetOutput() << setw(4) << m_context.GetObjectCode().GetPC() << "   ";
+			m_context.GetOutput() << setw(2) << ( value & 0xFF ) << " ";
+			m_context.GetOutput() << setw(2) << ( ( value & 0xFF00 ) >> 8 );
+			m_context.GetOutput() << endl << nouppercase << dec << setfill( ' ' );
 		}
 
 		try
 		{
-			ObjectCode::Instance().PutByte( value & 0xFF );
-			ObjectCode::Instance().PutByte( ( value & 0xFF00 ) >> 8 );
+			m_context.GetObjectCode().PutByte( value & 0xFF );
+			m_context.GetObjectCode().PutByte( ( value & 0xFF00 ) >> 8 );
 		}
 		catch ( AsmException_AssembleError& e )
 		{
@@ -1082,21 +1129,21 @@ void LineParser::HandleEqud()
 	{
 		if ( m_sourceCode->ShouldOutputAsm() )
 		{
-			cout << uppercase << hex << setfill( '0' ) << "     ";
-			cout << setw(4) << ObjectCode::Instance().GetPC() << "   ";
-			cout << setw(2) << ( value & 0xFF ) << " ";
-			cout << setw(2) << ( ( value & 0xFF00 ) >> 8 ) << " ";
-			cout << setw(2) << ( ( value & 0xFF0000 ) >> 16 ) << " ";
-			cout << setw(2) << ( ( value & 0xFF000000 ) >> 24 );
-			cout << endl << nouppercase << dec << setfill( ' ' );
+			m_context.GetOutput() << uppercase << hex << setfill( '0' ) << "     ";
+			m_context.GetOutput() << setw(4) << m_context.GetObjectCode().GetPC() << "   ";
+			m_context.GetOutput() << setw(2) << ( value & 0xFF ) << " ";
+			m_context.GetOutput() << setw(2) << ( ( value & 0xFF00 ) >> 8 ) << " ";
+			m_context.GetOutput() << setw(2) << ( ( value & 0xFF0000 ) >> 16 ) << " ";
+			m_context.GetOutput() << setw(2) << ( ( value & 0xFF000000 ) >> 24 );
+			m_context.GetOutput() << endl << nouppercase << dec << setfill( ' ' );
 		}
 
 		try
 		{
-			ObjectCode::Instance().PutByte( value & 0xFF );
-			ObjectCode::Instance().PutByte( ( value & 0xFF00 ) >> 8 );
-			ObjectCode::Instance().PutByte( ( value & 0xFF0000 ) >> 16 );
-			ObjectCode::Instance().PutByte( ( value & 0xFF000000 ) >> 24 );
+			m_context.GetObjectCode().PutByte( value & 0xFF );
+			m_context.GetObjectCode().PutByte( ( value & 0xFF00 ) >> 8 );
+			m_context.GetObjectCode().PutByte( ( value & 0xFF0000 ) >> 16 );
+			m_context.GetObjectCode().PutByte( ( value & 0xFF000000 ) >> 24 );
 		}
 		catch ( AsmException_AssembleError& e )
 		{
@@ -1129,31 +1176,21 @@ void LineParser::HandleAssert()
 	{
 		unsigned int value;
 
-		try
-		{
-			// Take a copy of the column before evaluating the expression so
-			// we can point correctly at the failed expression when throwing.
-			size_t column = m_column;
-			value = EvaluateExpressionAsUnsignedInt();
-			// We never throw for value being false on the first pass, simply
-			// to ensure that if two assertions both fail, the one which 
-			// appears earliest in the source will be reported.
-			if ( !GlobalData::Instance().IsFirstPass() && !value )
-			{
-				while ( ( column < m_line.length() ) && isspace( static_cast< unsigned char >( m_line[ column ] ) ) )
-				{
-					column++;
-				}
+		// Take a copy of the column before evaluating the expression so
+		// we can point correctly at the failed expression when throwing.
+		size_t column = m_column;
 
-				throw AsmException_SyntaxError_AssertionFailed( m_line, column );
-			}
-		}
-		catch ( AsmException_SyntaxError_SymbolNotDefined& )
+		// We never throw for value being false on the first pass, simply
+		// to ensure that if two assertions both fail, the one which 
+		// appears earliest in the source will be reported.
+		if ( TryEvaluateExpressionAsUnsignedInt( value ) && !m_context.GetGlobalData().IsFirstPass() && !value )
 		{
-			if ( !GlobalData::Instance().IsFirstPass() )
+			while ( ( column < m_line.length() ) && isspace( static_cast< unsigned char >( m_line[ column ] ) ) )
 			{
-				throw;
+				column++;
 			}
+
+			throw AsmException_SyntaxError_AssertionFailed( m_line, column );
 		}
 
 		if ( !AdvanceAndCheckEndOfStatement() )
@@ -1200,19 +1237,19 @@ void LineParser::HandleSave()
 
 	if ( saveFile.empty() )
 	{
-		if ( GlobalData::Instance().GetOutputFile() != NULL )
+		if ( m_context.GetGlobalData().GetOutputFile() != NULL )
 		{
-			saveFile = GlobalData::Instance().GetOutputFile();
+			saveFile = m_context.GetGlobalData().GetOutputFile();
 
-			if ( GlobalData::Instance().IsSecondPass() )
+			if ( m_context.GetGlobalData().IsSecondPass() )
 			{
-				if ( GlobalData::Instance().GetNumAnonSaves() > 0 )
+				if ( m_context.GetGlobalData().GetNumAnonSaves() > 0 )
 				{
 					throw AsmException_SyntaxError_OnlyOneAnonSave( m_line, saveParam.Column() );
 				}
 				else
 				{
-					GlobalData::Instance().IncNumAnonSaves();
+					m_context.GetGlobalData().IncNumAnonSaves();
 				}
 			}
 		}
@@ -1224,43 +1261,92 @@ void LineParser::HandleSave()
 
 	if ( m_sourceCode->ShouldOutputAsm() )
 	{
-		cout << "Saving file '" << saveFile << "'" << endl;
+		m_context.GetOutput() << "Saving file '" << saveFile << "'" << endl;
 	}
 
 	// OK - do it
 
-	if ( GlobalData::Instance().IsSecondPass() )
+	if ( m_context.GetGlobalData().IsSecondPass() )
 	{
-		if ( GlobalData::Instance().UsesDiscImage() )
+		if ( m_context.GetGlobalData().UsesDiscImage() )
 		{
 			// disc image version of the save
-			GlobalData::Instance().GetDiscImage()->AddFile( saveFile.c_str(),
-															ObjectCode::Instance().GetAddr( start ),
+			m_context.GetGlobalData().GetDiscImage()->AddFile( saveFile.c_str(),
+															m_context.GetObjectCode().GetAddr( start ),
 															reload,
 															exec,
 															end - start );
 		}
+		else if ( m_context.KeepsSavedFiles() )
+		{
+			// in-memory version of the save, for a program embedding the assembler
+			m_context.KeepSavedFile( saveFile,
+									 m_context.GetObjectCode().GetAddr( start ),
+									 reload,
+									 exec,
+									 end - start );
+		}
 		else
 		{
-			// regular save
-			ofstream objFile;
-
-			objFile.open( saveFile.c_str(), ios_base::out | ios_base::binary | ios_base::trunc );
+			// regular save, which leaves the file alone if it hasn't changed
+			OutputFile::Result result = OutputFile::WriteIfChanged( saveFile,
+																	 reinterpret_cast< const char* >( m_context.GetObjectCode().GetAddr( start ) ),
+																	 end - start );
 
-			if ( !objFile )
+			if ( result == OutputFile::OPEN_FAILED )
 			{
 				throw AsmException_FileError_OpenObj( saveFile );
 			}
 
-			if ( !objFile.write( reinterpret_cast< const char* >( ObjectCode::Instance().GetAddr( start ) ), end - start ) )
+			if ( result == OutputFile::WRITE_FAILED )
 			{
 				throw AsmException_FileError_WriteObj( saveFile );
 			}
 
-			objFile.close();
+			m_context.NoteFileWritten( saveFile );
+		}
+
+		m_context.GetGlobalData().SetSaved();
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::HandleLoadOrder()
+*/
+/*************************************************************************************************/
+void LineParser::HandleLoadOrder()
+{
+	// syntax is LOADORDER "filename" [, "filename" ...]
+
+	ArgListParser args(*this);
+
+	vector< string > filenames;
+
+	for ( ;; )
+	{
+		StringArg filename = args.ParseString();
+
+		if ( !filename.Found() && !filenames.empty() )
+		{
+			break;
 		}
 
-		GlobalData::Instance().SetSaved();
+		filenames.push_back( filename );
+	}
+
+	args.CheckComplete();
+
+	// Files are only laid out on disc images, and only once they've all been saved
+
+	if ( m_context.GetGlobalData().IsSecondPass() && m_context.GetGlobalData().UsesDiscImage() )
+	{
+		for ( vector< string >::const_iterator it = filenames.begin(); it != filenames.end(); ++it )
+		{
+			m_context.GetGlobalData().GetDiscImage()->AddToLoadOrder( it->c_str() );
+		}
 	}
 }
 
@@ -1295,7 +1381,7 @@ void LineParser::HandleFor()
 
 	// Check variable has not yet been defined
 
-	if ( SymbolTable::Instance().IsSymbolDefined( symbolName ) )
+	if ( m_context.GetSymbolTable().IsSymbolDefined( symbolName ) )
 	{
 		throw AsmException_SyntaxError_LabelAlreadyDefined( m_line, oldColumn );
 	}
@@ -1423,25 +1509,14 @@ void LineParser::HandlePrint()
 
 			int value;
 
-			try
-			{
-				value = EvaluateExpressionAsInt();
-			}
-			catch ( AsmException_SyntaxError_SymbolNotDefined& )
+			if ( !TryEvaluateExpressionAsInt( value ) )
 			{
-				if ( GlobalData::Instance().IsFirstPass() )
-				{
-					value = 0;
-				}
-				else
-				{
-					throw;
-				}
+				value = 0;
 			}
 
-			if ( GlobalData::Instance().IsSecondPass() )
+			if ( m_context.GetGlobalData().IsSecondPass() )
 			{
-				cout << hex << uppercase << "&" << value << dec << nouppercase << " ";
+				m_context.GetOutput() << hex << uppercase << "&" << value << dec << nouppercase << " ";
 			}
 		}
 		else
@@ -1454,20 +1529,20 @@ void LineParser::HandlePrint()
 
 			if ( !strncmp( m_line.c_str() + m_column, filelineKeyword, filelineKeywordLength ) )
 			{
-				if ( !GlobalData::Instance().IsFirstPass() )
+				if ( !m_context.GetGlobalData().IsFirstPass() )
 				{
-					cout << StringUtils::FormattedErrorLocation( m_sourceCode->GetFilename(), m_sourceCode->GetLineNumber() );
+					m_context.GetOutput() << StringUtils::FormattedErrorLocation( m_sourceCode->GetFilename(), m_sourceCode->GetLineNumber(), m_context.GetGlobalData().UseVisualCppErrorFormat() );
 				}
 				m_column += filelineKeywordLength ;
 			}
 			else if ( !strncmp( m_line.c_str() + m_column, callstackKeyword, callstackKeywordLength ) )
 			{
-				if ( !GlobalData::Instance().IsFirstPass() )
+				if ( !m_context.GetGlobalData().IsFirstPass() )
 				{
-					cout << StringUtils::FormattedErrorLocation( m_sourceCode->GetFilename(), m_sourceCode->GetLineNumber() );
+					m_context.GetOutput() << StringUtils::FormattedErrorLocation( m_sourceCode->GetFilename(), m_sourceCode->GetLineNumber(), m_context.GetGlobalData().UseVisualCppErrorFormat() );
 					for ( const SourceCode* s = m_sourceCode->GetParent(); s; s = s->GetParent() )
 					{
-						cout << endl << StringUtils::FormattedErrorLocation( s->GetFilename(), s->GetLineNumber() );
+						m_context.GetOutput() << endl << StringUtils::FormattedErrorLocation( s->GetFilename(), s->GetLineNumber(), m_context.GetGlobalData().UseVisualCppErrorFormat() );
 					}
 				}
 				m_column += callstackKeywordLength;
@@ -1477,25 +1552,14 @@ void LineParser::HandlePrint()
 				// print number in decimal or string
 
 				Value value;
+				TryEvaluateExpression( value );
 
-				try
-				{
-					value = EvaluateExpression();
-				}
-				catch ( AsmException_SyntaxError_SymbolNotDefined& )
-				{
-					if ( GlobalData::Instance().IsSecondPass() )
-					{
-						throw;
-					}
-				}
-
-				if ( GlobalData::Instance().IsSecondPass() )
+				if ( m_context.GetGlobalData().IsSecondPass() )
 				{
 					if (value.GetType() == Value::NumberValue)
 					{
-						StringUtils::PrintNumber(cout, value.GetNumber());
-						cout << " ";
+						StringUtils::PrintNumber(m_context.GetOutput(), value.GetNumber());
+						m_context.GetOutput() << " ";
 					}
 					else if (value.GetType() == Value::StringValue)
 					{
@@ -1503,7 +1567,7 @@ void LineParser::HandlePrint()
 						const char* pstr = text.Text();
 						for (unsigned int i = 0; i != text.Length(); ++i)
 						{
-							cout << *pstr;
+							m_context.GetOutput() << *pstr;
 							++pstr;
 						}
 					}
@@ -1512,9 +1576,9 @@ void LineParser::HandlePrint()
 		}
 	}
 
-	if ( GlobalData::Instance().IsSecondPass() )
+	if ( m_context.GetGlobalData().IsSecondPass() )
 	{
-		cout << endl;
+		m_context.GetOutput() << endl;
 	}
 }
 
@@ -1563,12 +1627,11 @@ void LineParser::HandlePutFileCommon( bool bText )
 
 	args.CheckComplete();
 
-	if ( GlobalData::Instance().IsSecondPass() )
+	if ( m_context.GetGlobalData().IsSecondPass() )
 	{
-		ifstream inputFile;
-		inputFile.open( hostFilename.c_str(), ios_base::in | ios_base::binary );
+		FileContents contents = m_context.GetFile( hostFilename );
 
-		if ( !inputFile )
+		if ( !contents )
 		{
 			AsmException_AssembleError_FileOpen e;
 			e.SetString( m_line );
@@ -1576,53 +1639,53 @@ void LineParser::HandlePutFileCommon( bool bText )
 			throw e;
 		}
 
-		inputFile.seekg( 0, ios_base::end );
-		size_t fileSize = static_cast< size_t >( inputFile.tellg() );
-		inputFile.seekg( 0, ios_base::beg );
+		const char* data = contents->data();
+		size_t fileSize = contents->length();
 
-		char* buffer = new char[ fileSize ];
+		string text;
 		if ( bText )
 		{
-			fileSize = 0;
-			int c;
-			while ( ( c = inputFile.get() ) != EOF )
+			text.reserve( fileSize );
+			for ( size_t i = 0; i < fileSize; i++ )
 			{
+				char c = data[ i ];
 				if ( c == '\n' || c == '\r' )
 				{
 					// swallow other half of CRLF/LFCR, if present
-					int other_half = ( c == '\n' ) ? '\r' : '\n';
-					std::streampos p = inputFile.tellg();
-					if ( inputFile.get() != other_half )
+					char other_half = ( c == '\n' ) ? '\r' : '\n';
+					if ( i + 1 < fileSize && data[ i + 1 ] == other_half )
 					{
-						inputFile.seekg( p );
+						i++;
 					}
 
-					buffer[ fileSize ] = '\r';
+					text.push_back( '\r' );
 				}
 				else
 				{
-					buffer[ fileSize ] = c;
+					text.push_back( c );
 				}
-				++fileSize;
 			}
+			data = text.data();
+			fileSize = text.length();
 		}
-		else
-		{
-			inputFile.read( buffer, fileSize );
-		}
-		inputFile.close();
 
-		if ( GlobalData::Instance().UsesDiscImage() )
+		if ( m_context.GetGlobalData().UsesDiscImage() )
 		{
 			// disc image version of the save
-			GlobalData::Instance().GetDiscImage()->AddFile( beebFilename.c_str(),
-															reinterpret_cast< unsigned char* >( buffer ),
+			m_context.GetGlobalData().GetDiscImage()->AddFile( beebFilename.c_str(),
+															reinterpret_cast< const unsigned char* >( data ),
 															start,
 															exec,
 															fileSize );
 		}
-
-		delete [] buffer;
+		else if ( m_context.KeepsSavedFiles() )
+		{
+			m_context.KeepSavedFile( beebFilename,
+									 reinterpret_cast< const unsigned char* >( data ),
+									 start,
+									 exec,
+									 fileSize );
+		}
 	}
 }
 
@@ -1639,10 +1702,10 @@ void LineParser::HandlePutBasic()
 	string beebFilename = args.ParseString().Default(hostFilename);
 	args.CheckComplete();
 
-	if ( GlobalData::Instance().IsSecondPass() &&
-		 GlobalData::Instance().UsesDiscImage() )
+	if ( m_context.GetGlobalData().IsSecondPass() &&
+		 ( m_context.GetGlobalData().UsesDiscImage() || m_context.KeepsSavedFiles() ) )
 	{
-		FILE* basic_file = fopen(hostFilename.c_str(), "rb");
+		FileContents basic_file = m_context.GetFile( hostFilename );
 		if (!basic_file)
 		{
 			AsmException_AssembleError_FileOpen e;
@@ -1651,8 +1714,7 @@ void LineParser::HandlePutBasic()
 			throw e;
 		}
 		std::vector<unsigned char> tokenized;
-		TokenizeError err = tokenize_file(basic_file, tokenized);
-		fclose(basic_file);
+		TokenizeError err = tokenize_file(basic_file->data(), basic_file->length(), tokenized);
 		if (err.IsError())
 		{
 			std::stringstream message;
@@ -1660,12 +1722,19 @@ void LineParser::HandlePutBasic()
 			throw AsmException_UserError( m_line, m_column, message.str() );
 		}
 
-		// disc image version of the save
-		GlobalData::Instance().GetDiscImage()->AddFile( beebFilename.c_str(),
-														tokenized.data(),
-														0xFFFF1900,
-														0xFFFF8023,
-														tokenized.size() );
+		if ( m_context.GetGlobalData().UsesDiscImage() )
+		{
+			// disc image version of the save
+			m_context.GetGlobalData().GetDiscImage()->AddFile( beebFilename.c_str(),
+															tokenized.data(),
+															0xFFFF1900,
+															0xFFFF8023,
+															tokenized.size() );
+		}
+		else
+		{
+			m_context.KeepSavedFile( beebFilename, tokenized.data(), 0xFFFF1900, 0xFFFF8023, tokenized.size() );
+		}
 	}
 
 }
@@ -1687,7 +1756,7 @@ void LineParser::HandleMacro()
 
 	if ( Ascii::IsAlpha( m_line[ m_column ] ) || m_line[ m_column ] == '_' )
 	{
-		if ( !GlobalData::Instance().RequireDistinctOpcodes() )
+		if ( !m_context.GetGlobalData().RequireDistinctOpcodes() )
 		{
 			// If opcodes are not distinct (i.e. no -w option) then the macro name should not start with an instruction
 			int opcode = GetInstructionAndAdvanceColumn( false, CPU_65C02 );
@@ -1700,9 +1769,9 @@ void LineParser::HandleMacro()
 
 		macroName = GetSymbolName();
 
-		if ( GlobalData::Instance().IsFirstPass() )
+		if ( m_context.GetGlobalData().IsFirstPass() )
 		{
-			if ( MacroTable::Instance().Exists( macroName ) )
+			if ( m_context.GetMacroTable().Exists( macroName ) )
 			{
 				throw AsmException_SyntaxError_DuplicateMacroName( m_line, m_column );
 			}
@@ -1736,7 +1805,7 @@ void LineParser::HandleMacro()
 		{
 			string param = GetSymbolName();
 
-			if ( GlobalData::Instance().IsFirstPass() )
+			if ( m_context.GetGlobalData().IsFirstPass() )
 			{
 				m_sourceCode->GetCurrentMacro()->AddParameter( param );
 			}
@@ -1758,7 +1827,7 @@ void LineParser::HandleMacro()
 	// beginning of the macro definition, so any errors are reported on the correct line
 
 	if ( m_column == m_line.length() &&
-		 GlobalData::Instance().IsFirstPass() )
+		 m_context.GetGlobalData().IsFirstPass() )
 	{
 		m_sourceCode->GetCurrentMacro()->AddLine("\n");
 	}
@@ -1825,7 +1894,7 @@ void LineParser::HandleCopyBlock()
 
 	try
 	{
-		ObjectCode::Instance().CopyBlock( start, end, dest, GlobalData::Instance().IsFirstPass() );
+		m_context.GetObjectCode().CopyBlock( start, end, dest, m_context.GetGlobalData().IsFirstPass() );
 	}
 	catch ( AsmException_AssembleError& e )
 	{
@@ -1845,23 +1914,12 @@ void LineParser::HandleRandomize()
 {
 	unsigned int value;
 
-	try
-	{
-		value = EvaluateExpressionAsUnsignedInt();
-	}
-	catch ( AsmException_SyntaxError_SymbolNotDefined& )
+	if ( !TryEvaluateExpressionAsUnsignedInt( value ) )
 	{
-		if ( GlobalData::Instance().IsFirstPass() )
-		{
-			value = 0;
-		}
-		else
-		{
-			throw;
-		}
+		value = 0;
 	}
 
-	beebasm_srand( value );
+	m_context.GetRandom().Seed( value );
 
 	if ( m_column < m_line.length() && m_line[ m_column ] == ',' )
 	{
@@ -1892,7 +1950,7 @@ void LineParser::HandleAsm()
 	LineParser parser(m_sourceCode, assembly);
 
 	// Parse the mnemonic, don't require a non-alpha after it.
-	int instruction = parser.GetInstructionAndAdvanceColumn(false, ObjectCode::Instance().GetCPU());
+	int instruction = parser.GetInstructionAndAdvanceColumn(false, m_context.GetObjectCode().GetCPU());
 	if (instruction < 0)
 	{
 		throw AsmException_SyntaxError_MissingAssemblyInstruction( parser.m_line, parser.m_column );
@@ -20,379 +20,585 @@
 */
 /*************************************************************************************************/
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <sstream>
 #include "discimage.h"
 #include "asmexception.h"
+#include "filecache.h"
 #include "globaldata.h"
+#include "outputfile.h"
 #include "stringutils.h"
 
 using namespace std;
 
 
+static const int SECTORS_PER_TRACK = 10;
+static const int TRACK_SIZE = SECTORS_PER_TRACK * 0x100;
+
+
+
 /*************************************************************************************************/
 /**
-	BuildInputFileErrorMessage()
+	DiscImage::DiscImage()
 
-	Helper function to build detailed diagnostic message for input file read failures.
-	Examines stream state to provide actionable information about what went wrong.
+	DiscImage constructor
 
-	@param		description			What was being read (e.g., "catalogue", "sector 5")
-	@param		expectedBytes		Number of bytes attempted to read
-	@param		inputStream			The input stream that failed
-	@return		A detailed error message string
+	@param		globalData		The options of the assembly, which describe a new disc image
+	@param		pOutput			Filename of the disc image to write, once it's complete
+	@param		pInput			Filename of a disc image to add to (or null), which must have the
+								same number of sides
 */
 /*************************************************************************************************/
-static string BuildInputFileErrorMessage(
-	const string& description,
-	size_t expectedBytes,
-	ifstream& inputStream )
+DiscImage::DiscImage( const GlobalData& globalData, const char* pOutput, const char* pInput )
+	:	m_sides( globalData.GetDiscSides() ),
+		m_sectorsPerSide( globalData.GetDiscTracks() * SECTORS_PER_TRACK ),
+		m_outputFilename( pOutput )
 {
-	ostringstream msg;
+	// Room for whole sides, so that they're never moved as files are added
 
-	streamsize actualBytes = inputStream.gcount();
-	bool hitEof = inputStream.eof();
-	streampos currentPos = inputStream.tellg();
+	for ( vector< Side >::iterator side = m_sides.begin(); side != m_sides.end(); ++side )
+	{
+		side->m_sectors.reserve( m_sectorsPerSide * 0x100 );
+	}
 
-	msg << "Problem reading from disc image.";
+	// load input file if necessary; it's read whole, and shared with any other assemblies using
+	// it, through the file cache
 
-	// Add specific context about what was being read
-	msg << " Failed to read " << description;
-	msg << ": attempted " << expectedBytes << " bytes";
-	msg << ", got " << actualBytes;
+	if ( pInput != NULL )
+	{
+		FileContents inputFile = FileCache::Instance().GetFile( pInput );
 
-	// Add EOF information if applicable
-	if ( hitEof )
+		if ( !inputFile )
+		{
+			throw AsmException_FileError_OpenDiscSource( pInput );
+		}
+
+		for ( size_t i = 0; i < m_sides.size(); i++ )
+		{
+			ReadSide( m_sides[ i ], *inputFile, static_cast< int >( i ), pInput );
+		}
+	}
+	else
 	{
-		msg << " (unexpected end of file)";
+		// generate blank catalogs
+
+		for ( vector< Side >::iterator side = m_sides.begin(); side != m_sides.end(); ++side )
+		{
+			unsigned char* aCatalog = side->m_aCatalog;
+
+			memset( aCatalog, 0, 0x200 );
+			aCatalog[ 0x104 ] = globalData.GetDiscCycle();
+			aCatalog[ 0x106 ] = ( ( m_sectorsPerSide >> 8 ) & 0x03 ) | ( ( globalData.GetDiscOption() & 3 ) << 4);
+			aCatalog[ 0x107 ] = m_sectorsPerSide & 0xFF;
+
+			const std::string& title = globalData.GetDiscTitle();
+			strncpy( reinterpret_cast< char* >( aCatalog ), title.substr(0, 8).c_str(), 8);
+			if ( title.length() > 8 )
+			{
+				strncpy( reinterpret_cast< char* >( aCatalog + 0x100 ), title.substr(8, 4).c_str(), 4);
+			}
+
+			side->m_sectors.assign( 0x200, 0 );
+		}
+
+		// add in a boot file
+
+		if ( globalData.GetBootFile() != NULL )
+		{
+			ostringstream streamPlingBoot;
+			streamPlingBoot << "*BASIC\r*RUN " << globalData.GetBootFile() << "\r";
+			const std::string& strPlingBoot = streamPlingBoot.str();
+			AddFile( "!Boot", reinterpret_cast< const unsigned char* >( strPlingBoot.c_str() ), 0, 0xFFFFFF, strPlingBoot.length() );
+
+			m_sides[ 0 ].m_aCatalog[ 0x106 ] = ( m_sides[ 0 ].m_aCatalog[ 0x106 ] & 0x03 ) | 0x30;		// force *OPT to 3 (EXEC)
+		}
 	}
 
-	// Add current position if available
-	if ( currentPos != static_cast<streampos>(-1) )
+	// The files already on the disc stay where they are when those saved are laid out in load
+	// order; the boot file is always loaded first anyway
+
+	for ( vector< Side >::iterator side = m_sides.begin(); side != m_sides.end(); ++side )
 	{
-		msg << ". Position: " << currentPos;
+		side->m_numTemplateFiles = side->m_files.size();
+		side->m_templateEndSector = static_cast< int >( side->m_sectors.size() / 0x100 );
 	}
+}
 
-	msg << ".";
 
-	return msg.str();
+
+/*************************************************************************************************/
+/**
+	DiscImage::SectorOffset()
+
+	Where a sector of one side is in the image file
+
+	@param		sideNumber		The side, 0 or 1
+	@param		sector			The sector number on that side
+	@returns	int				Its offset in bytes
+*/
+/*************************************************************************************************/
+int DiscImage::SectorOffset( int sideNumber, int sector ) const
+{
+	if ( m_sides.size() == 1 )
+	{
+		return sector * 0x100;
+	}
+
+	// Double-sided images hold each track of side 0 followed by the same track of side 1
+
+	return ( sector / SECTORS_PER_TRACK ) * TRACK_SIZE * 2 +
+		   sideNumber * TRACK_SIZE +
+		   ( sector % SECTORS_PER_TRACK ) * 0x100;
 }
 
 
+
 /*************************************************************************************************/
 /**
-	DiscImage::DiscImage()
+	DiscImage::IndexName()
 
-	DiscImage constructor
+	The key under which a file is kept in a side's index: its directory and name, in upper case,
+	as DFS doesn't distinguish case
+
+	@param		dir				The directory, whose top bit (locked) is ignored
+	@param		pName			The name, padded to 7 characters
+	@returns	string
 */
 /*************************************************************************************************/
-DiscImage::DiscImage( const char* pOutput, const char* pInput )
-	:	m_outputFilename( pOutput )
+string DiscImage::IndexName( unsigned char dir, const char* pName )
 {
-	// open output file
+	string name( 1, Ascii::ToUpper( dir & 0x7F ) );
 
-	m_outputFile.open( pOutput, ios_base::out | ios_base::binary | ios_base::trunc );
-
-	if ( !m_outputFile )
+	for ( size_t i = 0; i < 7; i++ )
 	{
-		throw AsmException_FileError_OpenDiscDest( pOutput );
+		name += Ascii::ToUpper( pName[ i ] );
 	}
 
-	// open and load input file if necessary
+	return name;
+}
+
 
-	if ( pInput != NULL )
+
+/*************************************************************************************************/
+/**
+	DiscImage::ReadSide()
+
+	Reads one side of a disc image being added to: its catalogue, and the sectors holding its files
+
+	@param		side			Receives the side
+	@param		image			The contents of the disc image
+	@param		sideNumber		Which side it is
+	@param		pInput			Filename of the disc image
+*/
+/*************************************************************************************************/
+void DiscImage::ReadSide( Side& side, const string& image, int sideNumber, const char* pInput ) const
+{
+	// Read the catalogue
+
+	if ( image.length() < static_cast< size_t >( SectorOffset( sideNumber, 0 ) + 0x200 ) )
 	{
-		m_inputFile.open( pInput, ios_base::in | ios_base::binary );
+		throw AsmException_FileError_ReadDiscSource( pInput );
+	}
 
-		if ( !m_inputFile )
-		{
-			throw AsmException_FileError_OpenDiscSource( pInput );
-		}
+	memcpy( side.m_aCatalog, image.data() + SectorOffset( sideNumber, 0 ), 0x200 );
 
-		// Read the catalogue
-		if ( !m_inputFile.read( reinterpret_cast< char* >( m_aCatalog ), 0x200 ) )
-		{
-			throw AsmException_FileError_ReadDiscSource( pInput );
-		}
+	// List its files, which are catalogued with the most recently added first
 
-		// copy the disc contents to the output file
+	const unsigned char* aCatalog = side.m_aCatalog;
 
-		int endSectorAddr;
+	for ( int i = aCatalog[ 0x105 ] & ~7; i > 0; i -= 8 )
+	{
+		File file;
+		memcpy( file.m_name, aCatalog + i, 7 );
+		file.m_dir = aCatalog[ i + 7 ];
+
+		const unsigned char* aInfo = aCatalog + 0x100 + i;
+		file.m_load			= aInfo[ 0 ] + ( aInfo[ 1 ] << 8 ) + ( ( ( aInfo[ 6 ] >> 2 ) & 0x03 ) << 16 );
+		file.m_exec			= aInfo[ 2 ] + ( aInfo[ 3 ] << 8 ) + ( ( ( aInfo[ 6 ] >> 6 ) & 0x03 ) << 16 );
+		file.m_length		= aInfo[ 4 ] + ( aInfo[ 5 ] << 8 ) + ( ( ( aInfo[ 6 ] >> 4 ) & 0x03 ) << 16 );
+		file.m_startSector	= aInfo[ 7 ] + ( ( aInfo[ 6 ] & 0x03 ) << 8 );
+
+		side.m_files.push_back( file );
+		side.m_names.insert( IndexName( file.m_dir, file.m_name ) );
+	}
 
-		if ( m_aCatalog[ 0x105 ] > 0 )
-		{
-			int sectorAddrOfLastFile	= m_aCatalog[ 0x10F ] +
-										  ( ( m_aCatalog[ 0x10E ] & 0x03 ) << 8 );
+	// copy the disc contents to the output image
 
-			int lengthOfLastFile		= m_aCatalog[ 0x10C ] +
-										  ( m_aCatalog[ 0x10D ] << 8 ) +
-										  ( ( m_aCatalog[ 0x10E ] & 0x30 ) << 12 );
+	int endSectorAddr = 2;
 
-			endSectorAddr = sectorAddrOfLastFile + ( ( lengthOfLastFile + 0xFF ) >> 8 );
-		}
-		else
-		{
-			endSectorAddr = 2;
-		}
+	if ( !side.m_files.empty() )
+	{
+		const File& lastFile = side.m_files.back();
+		endSectorAddr = max( lastFile.m_startSector + ( ( lastFile.m_length + 0xFF ) >> 8 ), 2 );
+	}
 
-		// Validate that the input file is large enough for the expected sectors
-		m_inputFile.seekg( 0, ios::end );
-		int length = static_cast< int >( m_inputFile.tellg() );
+	// Validate that the input file is large enough for the expected sectors
+	int length = static_cast< int >( image.length() );
+	int expectedLength = SectorOffset( sideNumber, endSectorAddr - 1 ) + 0x100;
 
-		if ( length < endSectorAddr * 0x100 )
-		{
-			ostringstream errorMsg;
-			errorMsg << "Disc image is too small. Expected at least "
-			         << (endSectorAddr * 0x100) << " bytes, but file is "
-			         << length << " bytes.";
-			throw AsmException_FileError_ReadDiscSource( pInput, errorMsg.str() );
-		}
+	if ( length < expectedLength )
+	{
+		ostringstream errorMsg;
+		errorMsg << "Disc image is too small. Expected at least "
+		         << expectedLength << " bytes, but file is "
+		         << length << " bytes.";
+		throw AsmException_FileError_ReadDiscSource( pInput, errorMsg.str() );
+	}
 
-		// Seek to position 0x200 to read the remaining data sectors
-		m_inputFile.seekg( 0x200, ios::beg );
+	// Copy the file data sectors (2 onwards), leaving room for the catalogue (sectors 0-1), which
+	// is filled in from the list of files when the image is written
 
-		// Write the catalogue (sectors 0-1) directly from the in-memory buffer.
-		// This avoids redundant I/O and is consistent with the destructor
-		// which also writes the catalogue from m_aCatalog.
+	side.m_sectors.assign( 0x200, 0 );
 
-		if ( !m_outputFile.write( reinterpret_cast< char* >( m_aCatalog ), 0x200 ) )
-		{
-			throw AsmException_FileError_WriteDiscDest( pOutput );
-		}
+	int sector = 2;
+
+	while ( sector < endSectorAddr )
+	{
+		// Sectors are only contiguous within a track
+		int sectors = min( SECTORS_PER_TRACK - sector % SECTORS_PER_TRACK, endSectorAddr - sector );
+		side.m_sectors.append( image, SectorOffset( sideNumber, sector ), sectors * 0x100 );
+		sector += sectors;
+	}
+}
 
-		// Copy the remaining file data sectors (2 onwards) from the input disc image.
-		// The input file pointer is correctly positioned at offset 0x200 (start of sector 2)
-		// after the initial catalogue read
 
-		char sector[ 0x100 ];
 
-		for ( int sect = 2; sect < endSectorAddr; sect++ )
-		{
-			if ( !m_inputFile.read( sector, 0x100 ) )
-			{
-				// Build detailed diagnostic message
-				ostringstream desc;
-				desc << "sector " << sect;
-				string errorMsg = BuildInputFileErrorMessage( desc.str(), 0x100, m_inputFile );
-				throw AsmException_FileError_ReadDiscSource( pInput, errorMsg );
-			}
+/*************************************************************************************************/
+/**
+	DiscImage::LayOutFiles()
 
-			if ( !m_outputFile.write( sector, 0x100 ) )
-			{
-				throw AsmException_FileError_WriteDiscDest( pOutput );
-			}
-		}
+	Moves the files saved to a side so that those in its load order come first, in that order,
+	followed by the rest in the order they were saved.  Each file still starts where the one
+	before it ends, so the catalogue stays in order and no space is wasted.
 
+	@param		side			The side
+*/
+/*************************************************************************************************/
+void DiscImage::LayOutFiles( Side& side ) const
+{
+	if ( side.m_loadOrder.empty() )
+	{
+		return;
 	}
-	else
+
+	// Work out the new order
+
+	vector< size_t > order;
+	vector< bool > placed( side.m_files.size(), false );
+
+	for ( vector< pair< string, string > >::const_iterator it = side.m_loadOrder.begin(); it != side.m_loadOrder.end(); ++it )
 	{
-		// generate a blank catalog
+		const string& name = it->first;
 
-		memset( m_aCatalog, 0, 0x200 );
-		m_aCatalog[ 0x104 ] = GlobalData::Instance().GetDiscCycle();
-		m_aCatalog[ 0x106 ] = 0x03 | ( ( GlobalData::Instance().GetDiscOption() & 3 ) << 4);
-		m_aCatalog[ 0x107 ] = 0x20;
+		if ( side.m_names.count( name ) == 0 )
+		{
+			throw AsmException_FileError_NotSaved( m_outputFilename,
+												   "File '" + it->second + "' in LOADORDER was not saved to the DFS disc image." );
+		}
 
-		const std::string& title = GlobalData::Instance().GetDiscTitle();
-		strncpy( reinterpret_cast< char* >( m_aCatalog ), title.substr(0, 8).c_str(), 8);
-		if ( title.length() > 8 )
+		// A file already on the disc can't be moved, and a file can only be loaded first once
+
+		for ( size_t i = side.m_numTemplateFiles; i < side.m_files.size(); i++ )
 		{
-			strncpy( reinterpret_cast< char* >( m_aCatalog + 0x100 ), title.substr(8, 4).c_str(), 4);
+			if ( !placed[ i ] && IndexName( side.m_files[ i ].m_dir, side.m_files[ i ].m_name ) == name )
+			{
+				order.push_back( i );
+				placed[ i ] = true;
+				break;
+			}
 		}
+	}
 
-		if ( !m_outputFile.write( reinterpret_cast< char* >( m_aCatalog ), 0x200 ) )
+	for ( size_t i = side.m_numTemplateFiles; i < side.m_files.size(); i++ )
+	{
+		if ( !placed[ i ] )
 		{
-			// write error
-			throw AsmException_FileError_WriteDiscDest( m_outputFilename );
+			order.push_back( i );
 		}
+	}
 
-		// add in a boot file
+	// Copy the files into their new places
 
-		if ( GlobalData::Instance().GetBootFile() != NULL )
-		{
-			ostringstream streamPlingBoot;
-			streamPlingBoot << "*BASIC\r*RUN " << GlobalData::Instance().GetBootFile() << "\r";
-			const std::string& strPlingBoot = streamPlingBoot.str();
-			AddFile( "!Boot", reinterpret_cast< const unsigned char* >( strPlingBoot.c_str() ), 0, 0xFFFFFF, strPlingBoot.length() );
+	vector< File > files( side.m_files.begin(), side.m_files.begin() + side.m_numTemplateFiles );
+	string sectors( side.m_sectors, 0, side.m_templateEndSector * 0x100 );
 
-			m_aCatalog[ 0x106 ] = 0x33;		// force *OPT to 3 (EXEC)
-		}
+	for ( vector< size_t >::const_iterator i = order.begin(); i != order.end(); ++i )
+	{
+		File file = side.m_files[ *i ];
+		int startSector = static_cast< int >( sectors.size() / 0x100 );
+
+		sectors.append( side.m_sectors, file.m_startSector * 0x100, file.m_length );
+		sectors.resize( ( sectors.size() + 0xFF ) & ~0xFF, 0 );
+
+		file.m_startSector = startSector;
+		files.push_back( file );
 	}
 
+	side.m_files.swap( files );
+	side.m_sectors.swap( sectors );
 }
 
 
 
 /*************************************************************************************************/
 /**
-	DiscImage::~DiscImage()
+	DiscImage::WriteCatalogue()
+
+	Fills in the entries of a side's catalogue from its list of files
 
-	DiscImage destructor
+	@param		side			The side
 */
 /*************************************************************************************************/
-DiscImage::~DiscImage()
+void DiscImage::WriteCatalogue( Side& side ) const
 {
-	// write back the catalog
+	unsigned char* aCatalog = side.m_aCatalog;
 
-	m_outputFile.seekp( 0, ios::beg );
-	if ( !m_outputFile.write( reinterpret_cast< char* >( m_aCatalog ), 0x200 ) )
+	// Write the file count
+
+	aCatalog[ 0x105 ] = static_cast< unsigned char >( side.m_files.size() * 8 );
+
+	// The most recently added file comes first
+
+	int i = 8;
+
+	for ( vector< File >::const_reverse_iterator file = side.m_files.rbegin(); file != side.m_files.rend(); ++file, i += 8 )
 	{
-		// don't throw an exception in the destructor, just bear it silently..!
+		// Write filename and directory name
+
+		memcpy( aCatalog + i, file->m_name, 7 );
+		aCatalog[ i + 7 ] = file->m_dir;
+
+		unsigned char* aInfo = aCatalog + 0x100 + i;
+
+		// Write load address, exec address and length
+
+		aInfo[ 0 ] = file->m_load & 0xFF;
+		aInfo[ 1 ] = ( file->m_load & 0xFF00 ) >> 8;
+		aInfo[ 2 ] = file->m_exec & 0xFF;
+		aInfo[ 3 ] = ( file->m_exec & 0xFF00 ) >> 8;
+		aInfo[ 4 ] = file->m_length & 0xFF;
+		aInfo[ 5 ] = ( file->m_length & 0xFF00 ) >> 8;
+
+		// Write miscellaneous bits
+
+		aInfo[ 6 ] = ( ( ( file->m_load >> 16 ) & 0x03 ) << 2 ) |
+					 ( ( ( file->m_exec >> 16 ) & 0x03 ) << 6 ) |
+					 ( ( ( file->m_length >> 16 ) & 0x03 ) << 4 ) |
+					 ( ( file->m_startSector >> 8 ) & 0x03 );
+
+		// Write sector start
+
+		aInfo[ 7 ] = file->m_startSector & 0xFF;
 	}
 
-	m_outputFile.close();
-	m_inputFile.close();
+	side.m_sectors.replace( 0, 0x200, reinterpret_cast< const char* >( aCatalog ), 0x200 );
 }
 
 
 
 /*************************************************************************************************/
 /**
-	DiscImage::AddFile()
+	DiscImage::Write()
+
+	Writes out the finished disc image, unless the file already holds exactly the same image, in
+	which case it's left alone so that its modification time is kept
 */
 /*************************************************************************************************/
-void DiscImage::AddFile( const char* pName, const unsigned char* pAddr, int load, int exec, int len )
+void DiscImage::Write()
 {
-	char dirName = '$';
+	string image;
 
-	if ( strlen( pName ) > 2 && pName[ 1 ] == '.' )
+	for ( vector< Side >::iterator side = m_sides.begin(); side != m_sides.end(); ++side )
 	{
-		dirName = pName[ 0 ];
-		pName += 2;
+		LayOutFiles( *side );
+		WriteCatalogue( *side );
 	}
 
-	if ( strlen( pName ) > 7 )
+	if ( m_sides.size() == 1 )
 	{
-		// Bad name
-		throw AsmException_FileError_BadName( m_outputFilename );
+		image.swap( m_sides[ 0 ].m_sectors );
 	}
-
-	char pPaddedName[ 7 ];
-	memset( pPaddedName, ' ', 7 );
-	memcpy( pPaddedName, pName, strlen( pName ) );
-
-	if ( m_aCatalog[ 0x105 ] == 31*8 )
+	else
 	{
-		// Catalog full
-		throw AsmException_FileError_TooManyFiles( m_outputFilename );
-	}
+		// interleave the sides, each padded to a whole number of tracks
 
-	// Check the file doesn't already exist
+		size_t tracks = 0;
 
-	for ( int i = m_aCatalog[ 0x105 ]; i > 0; i -= 8 )
-	{
-		bool bTheSame = true;
+		for ( vector< Side >::const_iterator side = m_sides.begin(); side != m_sides.end(); ++side )
+		{
+			tracks = max( tracks, ( side->m_sectors.size() + TRACK_SIZE - 1 ) / TRACK_SIZE );
+		}
+
+		image.assign( tracks * TRACK_SIZE * m_sides.size(), 0 );
 
-		for ( size_t j = 0; j < 7; j++ )
+		for ( size_t i = 0; i < m_sides.size(); i++ )
 		{
-			if ( Ascii::ToUpper( pPaddedName[ j ] ) != Ascii::ToUpper( m_aCatalog[ i + j ] ) )
+			const string& sectors = m_sides[ i ].m_sectors;
+
+			for ( size_t offset = 0; offset < sectors.size(); offset += TRACK_SIZE )
 			{
-				bTheSame = false;
-				break;
+				size_t length = min( sectors.size() - offset, static_cast< size_t >( TRACK_SIZE ) );
+				image.replace( SectorOffset( static_cast< int >( i ), static_cast< int >( offset / 0x100 ) ),
+							   length,
+							   sectors,
+							   offset,
+							   length );
 			}
 		}
+	}
 
-		if ( bTheSame && ( Ascii::ToUpper( m_aCatalog[ i + 7 ] & 0x7F ) ) == Ascii::ToUpper( dirName ) )
-		{
-			// File already exists
-			throw AsmException_FileError_FileExists( m_outputFilename );
-		}
+	switch ( OutputFile::WriteIfChanged( m_outputFilename, image ) )
+	{
+		case OutputFile::OPEN_FAILED:
+			throw AsmException_FileError_OpenDiscDest( m_outputFilename );
+
+		case OutputFile::WRITE_FAILED:
+			throw AsmException_FileError_WriteDiscDest( m_outputFilename );
+
+		default:
+			break;
 	}
+}
 
-	// Calculate sector address for the new file
 
-	int sectorAddrOfThisFile;
 
-	if ( m_aCatalog[ 0x105 ] > 0 )
-	{
-		int sectorAddrOfLastFile	= m_aCatalog[ 0x10F ] +
-									  ( ( m_aCatalog[ 0x10E ] & 0x03 ) << 8 );
+/*************************************************************************************************/
+/**
+	DiscImage::ParseName()
 
-		int lengthOfLastFile		= m_aCatalog[ 0x10C ] +
-									  ( m_aCatalog[ 0x10D ] << 8 ) +
-									  ( ( m_aCatalog[ 0x10E ] & 0x30 ) << 12 );
+	Splits a DFS filename, optionally starting with a drive and a directory, as in ":2.$.Name"
 
-		sectorAddrOfThisFile = sectorAddrOfLastFile + ( ( lengthOfLastFile + 0xFF ) >> 8 );
-	}
-	else
+	@param		pName			The filename
+	@param		dirName			Receives the directory, which is $ if none is given
+	@param		pPaddedName		Receives the name, padded with spaces to 7 characters
+	@returns	Side&			The side of the disc named by the drive
+*/
+/*************************************************************************************************/
+DiscImage::Side& DiscImage::ParseName( const char* pName, char& dirName, char* pPaddedName )
+{
+	int drive = 0;
+
+	if ( pName[ 0 ] == ':' && pName[ 1 ] != '\0' && pName[ 2 ] == '.' )
 	{
-		sectorAddrOfThisFile = 2;
+		drive = pName[ 1 ] - '0';
+		pName += 3;
 	}
 
-	int sectorLengthOfThisFile	= ( len + 0xFF ) >> 8;
+	// Drive 2 is the other side of drive 0
 
-	if ( sectorAddrOfThisFile + sectorLengthOfThisFile > 800 )
+	if ( drive != 0 && ( drive != 2 || m_sides.size() != 2 ) )
 	{
-		// Disc full
-		throw AsmException_FileError_DiscFull( m_outputFilename );
+		// Bad drive
+		throw AsmException_FileError_BadDrive( m_outputFilename );
 	}
 
-	// Make space in the catalog for the new file
+	dirName = '$';
 
-	for ( int i = m_aCatalog[ 0x105 ]; i > 0; i -= 8 )
+	if ( strlen( pName ) > 2 && pName[ 1 ] == '.' )
 	{
-		for ( int j = 0; j < 8; j++ )
-		{
-			m_aCatalog[ i + j + 8 ] = m_aCatalog[ i + j ];
-			m_aCatalog[ i + j + 0x108 ] = m_aCatalog[ i + j + 0x100 ];
-		}
+		dirName = pName[ 0 ];
+		pName += 2;
 	}
 
-	// Increment the file count
+	if ( strlen( pName ) > 7 )
+	{
+		// Bad name
+		throw AsmException_FileError_BadName( m_outputFilename );
+	}
 
-	m_aCatalog[ 0x105 ] += 8;
+	memset( pPaddedName, ' ', 7 );
+	memcpy( pPaddedName, pName, strlen( pName ) );
 
-	// Write filename
+	return m_sides[ drive / 2 ];
+}
 
-	memcpy( m_aCatalog + 8, pPaddedName, 7 );
 
-	// Write directory name
 
-	m_aCatalog[ 15 ] = dirName;
+/*************************************************************************************************/
+/**
+	DiscImage::AddToLoadOrder()
 
-	// Write load address
+	Adds a file to the list of those which are loaded first, in the order they're loaded, so that
+	they can be laid out one after another from the start of the disc, and a loader reading them
+	in turn hardly has to move the drive head.  The file needn't have been saved yet.
 
-	m_aCatalog[ 0x108 ] = load & 0xFF;
-	m_aCatalog[ 0x109 ] = ( load & 0xFF00 ) >> 8;
+	@param		pName			The DFS filename
+*/
+/*************************************************************************************************/
+void DiscImage::AddToLoadOrder( const char* pName )
+{
+	char dirName;
+	char pPaddedName[ 7 ];
+	Side& side = ParseName( pName, dirName, pPaddedName );
 
-	// Write exec address
+	side.m_loadOrder.push_back( make_pair( IndexName( dirName, pPaddedName ), string( pName ) ) );
+}
 
-	m_aCatalog[ 0x10A ] = exec & 0xFF;
-	m_aCatalog[ 0x10B ] = ( exec & 0xFF00 ) >> 8;
 
-	// Write length
 
-	m_aCatalog[ 0x10C ] = len & 0xFF;
-	m_aCatalog[ 0x10D ] = ( len & 0xFF00 ) >> 8;
+/*************************************************************************************************/
+/**
+	DiscImage::AddFile()
+*/
+/*************************************************************************************************/
+void DiscImage::AddFile( const char* pName, const unsigned char* pAddr, int load, int exec, int len )
+{
+	char dirName;
+	char pPaddedName[ 7 ];
+	Side& side = ParseName( pName, dirName, pPaddedName );
 
-	// Write sector start
+	if ( side.m_files.size() == 31 )
+	{
+		// Catalog full
+		throw AsmException_FileError_TooManyFiles( m_outputFilename );
+	}
 
-	m_aCatalog[ 0x10F ] = sectorAddrOfThisFile & 0xFF;
+	// Check the file doesn't already exist
 
-	// Write miscellaneous bits
+	string indexName = IndexName( dirName, pPaddedName );
 
-	m_aCatalog[ 0x10E ] = ( ( ( load >> 16 ) & 0x03 ) << 2 ) |
-						  ( ( ( exec >> 16 ) & 0x03 ) << 6 ) |
-						  ( ( ( len  >> 16 ) & 0x03 ) << 4 ) |
-						  ( ( sectorAddrOfThisFile >> 8 ) & 0x03 );
+	if ( side.m_names.count( indexName ) != 0 )
+	{
+		// File already exists
+		throw AsmException_FileError_FileExists( m_outputFilename );
+	}
 
-	// Now write the actual file
+	// Calculate sector address for the new file
 
-	assert( static_cast< int >( m_outputFile.tellp() ) == sectorAddrOfThisFile * 0x100 );
+	int sectorAddrOfThisFile = 2;
 
-	if ( !m_outputFile.write( reinterpret_cast< const char* >( pAddr ), len ) )
+	if ( !side.m_files.empty() )
 	{
-		// Write error
-		throw AsmException_FileError_WriteDiscDest( m_outputFilename );
+		const File& lastFile = side.m_files.back();
+		sectorAddrOfThisFile = lastFile.m_startSector + ( ( lastFile.m_length + 0xFF ) >> 8 );
 	}
 
-	while ( ( m_outputFile.tellp() & 0xFF ) != 0 )
+	int sectorLengthOfThisFile	= ( len + 0xFF ) >> 8;
+
+	if ( sectorAddrOfThisFile + sectorLengthOfThisFile > m_sectorsPerSide )
 	{
-		if ( !m_outputFile.put( 0 ) )
-		{
-			// Write error
-			throw AsmException_FileError_WriteDiscDest( m_outputFilename );
-		}
+		// Disc full
+		throw AsmException_FileError_DiscFull( m_outputFilename );
 	}
+
+	// Add it to the catalog
+
+	File file;
+	memcpy( file.m_name, pPaddedName, 7 );
+	file.m_dir			= dirName;
+	file.m_load			= load;
+	file.m_exec			= exec;
+	file.m_length		= len;
+	file.m_startSector	= sectorAddrOfThisFile;
+
+	side.m_files.push_back( file );
+	side.m_names.insert( indexName );
+
+	// Now write the actual file
+
+	side.m_sectors.resize( sectorAddrOfThisFile * 0x100, 0 );
+	side.m_sectors.append( reinterpret_cast< const char* >( pAddr ), len );
+	side.m_sectors.resize( ( side.m_sectors.size() + 0xFF ) & ~0xFF, 0 );
 }
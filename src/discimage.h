@@ -23,25 +23,78 @@
 #ifndef DISCIMAGE_H_
 #define DISCIMAGE_H_
 
-#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 
+class GlobalData;
+
+// An Acorn DFS disc image, single-sided (.ssd) or double-sided with the sides interleaved track by
+// track (.dsd), of 40 or 80 tracks.  Each side has its own catalogue, and is reached by saving to
+// a filename starting ":0." or ":2.", as with DFS.  The whole image is built in memory, and only
+// written once it's complete, when the files saved can be rearranged into the order in which
+// they're loaded.
 class DiscImage
 {
 public:
 
-	explicit DiscImage( const char* pOutput, const char* pInput = NULL );
-	~DiscImage();
+	DiscImage( const GlobalData& globalData, const char* pOutput, const char* pInput = NULL );
 
 	void AddFile( const char* pName, const unsigned char* pAddr, int load, int exec, int len );
+	void AddToLoadOrder( const char* pName );
+	void Write();
 
 
 private:
 
-	std::ofstream				m_outputFile;
-	std::ifstream				m_inputFile;
+	// A file in a catalogue
+	struct File
+	{
+		char					m_name[ 7 ];			// padded with spaces
+		unsigned char			m_dir;					// with the top bit set if it's locked
+		int						m_load;
+		int						m_exec;
+		int						m_length;
+		int						m_startSector;
+	};
+
+	// One side of the disc, with its own catalogue
+	struct Side
+	{
+		// The title, cycle number, *OPT and size of the side; the files' entries are filled in
+		// from m_files when the image is written
+		unsigned char					m_aCatalog[ 0x200 ];
+
+		// In the order they were added, so each starts where the one before it ended; those from
+		// a disc image being added to come first, and stay where they are
+		std::vector< File >				m_files;
+		size_t							m_numTemplateFiles;
+		int								m_templateEndSector;
+
+		// The directory and name of every file, in upper case, to find duplicates
+		std::unordered_set< std::string >	m_names;
+
+		// The side's sectors, with room at the start for the catalogue
+		std::string						m_sectors;
+
+		// The files saved which are loaded first, as given by LOADORDER: their index names, and
+		// their names as given
+		std::vector< std::pair< std::string, std::string > >	m_loadOrder;
+	};
+
+	static std::string IndexName( unsigned char dir, const char* pName );
+
+	Side& ParseName( const char* pName, char& dirName, char* pPaddedName );
+	void LayOutFiles( Side& side ) const;
+	void ReadSide( Side& side, const std::string& image, int sideNumber, const char* pInput ) const;
+	void WriteCatalogue( Side& side ) const;
+	int SectorOffset( int sideNumber, int sector ) const;
+
+	std::vector< Side >			m_sides;
+	int							m_sectorsPerSide;
 	const char*					m_outputFilename;
-	unsigned char				m_aCatalog[ 0x200 ];
 
 };
 
@@ -29,8 +29,10 @@
 #include <sstream>
 #include <iomanip>
 #include <climits>
+#include <mutex>
 
 #include "lineparser.h"
+#include "assemblycontext.h"
 #include "asmexception.h"
 #include "symboltable.h"
 #include "globaldata.h"
@@ -137,12 +139,17 @@ const LineParser::Operator	LineParser::m_gaUnaryOperatorTable[] =
 	- a symbol (label)
 	- a special value such as * (PC)
 
-	@return		double
+	@param		value			Receives the value
+	@param		bracketCount	The bracket depth of the value within the expression
+	@param		recording		If not NULL, the expression being compiled, to which the value is added
+
+	@return		false if the value is an undefined symbol, whose column is then left in
+				m_undefinedSymbolColumn
 */
 /*************************************************************************************************/
-Value LineParser::GetValue()
+bool LineParser::GetValue( Value& value, int bracketCount, CompiledExpression* recording )
 {
-	Value value;
+	size_t startColumn = m_column;
 
 	double double_value;
 	if ( Literals::ParseNumeric(m_line, m_column, double_value) )
@@ -154,7 +161,13 @@ Value LineParser::GetValue()
 		// get current PC
 
 		m_column++;
-		value = static_cast< double >( ObjectCode::Instance().GetPC() );
+		value = static_cast< double >( m_context.GetObjectCode().GetPC() );
+
+		if ( recording != NULL )
+		{
+			recording->AddOp( CompiledExpression::PUSH_PC, m_column );
+		}
+		return true;
 	}
 	else if ( m_column < m_line.length() && m_line[ m_column ] == '\'' )
 	{
@@ -215,17 +228,31 @@ Value LineParser::GetValue()
 		{
 			// Handle TIME$ with no parameters
 			value = FormatAssemblyTime("%a,%d %b %Y.%H:%M:%S");
+
+			if ( recording != NULL )
+			{
+				recording->AddOp( CompiledExpression::PUSH_TIME, m_column );
+			}
 		}
 		else
 		{
 			// Regular symbol
 
-			if ( !m_sourceCode->GetSymbolValue(symbolName, value) )
+			int nameId = SymbolNamePool::Instance().Intern( symbolName );
+
+			if ( !m_sourceCode->GetSymbolValue(nameId, value) )
 			{
 				// symbol not known
-				throw AsmException_SyntaxError_SymbolNotDefined( m_line, oldColumn );
+				m_undefinedSymbolColumn = oldColumn;
+				return false;
+			}
+
+			if ( recording != NULL )
+			{
+				recording->AddSymbol( nameId, oldColumn, m_column, bracketCount );
 			}
 		}
+		return true;
 	}
 	else
 	{
@@ -233,7 +260,14 @@ Value LineParser::GetValue()
 		throw AsmException_SyntaxError_InvalidCharacter( m_line, m_column );
 	}
 
-	return value;
+	// a literal, which is the same every time
+
+	if ( recording != NULL )
+	{
+		recording->AddValue( value, startColumn );
+	}
+
+	return true;
 }
 
 
@@ -246,6 +280,167 @@ Value LineParser::GetValue()
 */
 /*************************************************************************************************/
 Value LineParser::EvaluateExpression( bool bAllowOneMismatchedCloseBracket )
+{
+	Value value;
+
+	if ( !EvaluateExpressionIfDefined( value, bAllowOneMismatchedCloseBracket ) )
+	{
+		throw AsmException_SyntaxError_SymbolNotDefined( m_line, m_undefinedSymbolColumn );
+	}
+
+	return value;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::TryEvaluateExpression()
+
+	Version of EvaluateExpression for places where a symbol may be undefined on the first pass,
+	which returns false rather than throwing in that case.  On the second pass an undefined
+	symbol is still an error.
+
+	@param		value			Receives the value, if it was defined
+*/
+/*************************************************************************************************/
+bool LineParser::TryEvaluateExpression( Value& value, bool bAllowOneMismatchedCloseBracket )
+{
+	try
+	{
+		if ( EvaluateExpressionIfDefined( value, bAllowOneMismatchedCloseBracket ) )
+		{
+			return true;
+		}
+	}
+	catch ( AsmException_SyntaxError_SymbolNotDefined& )
+	{
+		// Thrown from an expression evaluated by an operator, e.g. EVAL
+
+		if ( m_context.GetGlobalData().IsSecondPass() )
+		{
+			throw;
+		}
+		return false;
+	}
+
+	if ( m_context.GetGlobalData().IsSecondPass() )
+	{
+		throw AsmException_SyntaxError_SymbolNotDefined( m_line, m_undefinedSymbolColumn );
+	}
+	return false;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::TryEvaluateExpressionAsInt()
+
+	Version of TryEvaluateExpression which returns its result as an int
+*/
+/*************************************************************************************************/
+bool LineParser::TryEvaluateExpressionAsInt( int& value, bool bAllowOneMismatchedCloseBracket )
+{
+	Value result;
+
+	if ( !TryEvaluateExpression( result, bAllowOneMismatchedCloseBracket ) )
+	{
+		return false;
+	}
+
+	if ( result.GetType() != Value::NumberValue )
+	{
+		throw AsmException_SyntaxError_TypeMismatch( m_line, m_column );
+	}
+
+	value = ConvertDoubleToInt( result.GetNumber() );
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::TryEvaluateExpressionAsUnsignedInt()
+
+	Version of TryEvaluateExpression which returns its result as an unsigned int
+*/
+/*************************************************************************************************/
+bool LineParser::TryEvaluateExpressionAsUnsignedInt( unsigned int& value, bool bAllowOneMismatchedCloseBracket )
+{
+	int result;
+
+	if ( !TryEvaluateExpressionAsInt( result, bAllowOneMismatchedCloseBracket ) )
+	{
+		return false;
+	}
+
+	value = static_cast< unsigned int >( result );
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::EvaluateExpressionIfDefined()
+
+	Evaluates an expression, advancing the string pointer.  Rather than throwing if a symbol is
+	undefined, returns false, having moved past the expression on the first pass.
+
+	If the line is cached, the expression is compiled the first time it is successfully evaluated,
+	and the compiled form is run on subsequent passes, loop iterations and macro expansions.
+
+	@param		value			Receives the value, if it was defined
+*/
+/*************************************************************************************************/
+bool LineParser::EvaluateExpressionIfDefined( Value& value, bool bAllowOneMismatchedCloseBracket )
+{
+	if ( m_lexedLine == NULL )
+	{
+		return ParseExpression( value, bAllowOneMismatchedCloseBracket, NULL );
+	}
+
+	const CompiledExpression* compiled = m_lexedLine->FindExpression( m_column, bAllowOneMismatchedCloseBracket );
+
+	if ( compiled != NULL )
+	{
+		return RunCompiledExpression( value, *compiled );
+	}
+
+	// If the evaluation fails, nothing is cached, and the expression will be parsed again next time
+
+	CompiledExpression recording( m_column, bAllowOneMismatchedCloseBracket );
+
+	if ( !ParseExpression( value, bAllowOneMismatchedCloseBracket, &recording ) )
+	{
+		return false;
+	}
+
+	recording.SetEndColumn( m_column );
+	m_lexedLine->AddExpression( recording );
+
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::ParseExpression()
+
+	Parses and evaluates an expression, and returns its value, also advancing the string pointer
+
+	@param		result								Receives the value
+	@param		bAllowOneMismatchedCloseBracket		Whether an extra close bracket ends the expression
+	@param		recording							If not NULL, the operations carried out are added
+													to it
+
+	@return		false if a symbol was undefined, whose column is left in m_undefinedSymbolColumn
+*/
+/*************************************************************************************************/
+bool LineParser::ParseExpression( Value& result, bool bAllowOneMismatchedCloseBracket, CompiledExpression* recording )
 {
 	// Reset stacks
 
@@ -322,15 +517,11 @@ Value LineParser::EvaluateExpression( bool bAllowOneMismatchedCloseBracket )
 
 				Value value;
 
-				try
-				{
-					value = GetValue();
-				}
-				catch ( AsmException_SyntaxError_SymbolNotDefined& )
+				if ( !GetValue( value, bracketCount, recording ) )
 				{
 					// If we encountered an unknown symbol whilst evaluating the expression...
 
-					if ( GlobalData::Instance().IsFirstPass() )
+					if ( m_context.GetGlobalData().IsFirstPass() )
 					{
 						// On first pass, we have to continue gracefully.
 						// This moves the string pointer to beyond the expression
@@ -338,8 +529,8 @@ Value LineParser::EvaluateExpression( bool bAllowOneMismatchedCloseBracket )
 						SkipExpression( bracketCount, bAllowOneMismatchedCloseBracket );
 					}
 
-					// Whatever happens, we throw the exception
-					throw;
+					// Whatever happens, the expression is undefined
+					return false;
 				}
 
 				m_valueStack[ m_valueStackPtr++ ] = value;
@@ -363,7 +554,7 @@ Value LineParser::EvaluateExpression( bool bAllowOneMismatchedCloseBracket )
 						OperatorHandler opHandler = m_operatorStack[ m_operatorStackPtr ].handler;
 						assert( opHandler != NULL );	// this should really not be possible!
 
-						( this->*opHandler )();
+						ApplyOperator( opHandler, recording );
 					}
 				}
 				else
@@ -437,7 +628,7 @@ Value LineParser::EvaluateExpression( bool bAllowOneMismatchedCloseBracket )
 					OperatorHandler opHandler = m_operatorStack[ m_operatorStackPtr ].handler;
 					assert( opHandler != NULL );	// this means the operator has been given a precedence of < 0
 
-					( this->*opHandler )();
+					ApplyOperator( opHandler, recording );
 				}
 
 				if ( m_operatorStackPtr == MAX_OPERATORS )
@@ -469,7 +660,7 @@ Value LineParser::EvaluateExpression( bool bAllowOneMismatchedCloseBracket )
 					OperatorHandler opHandler = m_operatorStack[ m_operatorStackPtr ].handler;
 					if ( opHandler != NULL )
 					{
-						( this->*opHandler )();
+						ApplyOperator( opHandler, recording );
 					}
 					else
 					{
@@ -545,7 +736,7 @@ Value LineParser::EvaluateExpression( bool bAllowOneMismatchedCloseBracket )
 		}
 		else
 		{
-			( this->*opHandler )();
+			ApplyOperator( opHandler, recording );
 		}
 	}
 
@@ -557,9 +748,140 @@ Value LineParser::EvaluateExpression( bool bAllowOneMismatchedCloseBracket )
 		throw AsmException_SyntaxError_EmptyExpression( m_line, m_column );
 	}
 
-	return m_valueStack[ 0 ];
+	result = m_valueStack[ 0 ];
+	return true;
+}
+
+/*************************************************************************************************/
+/**
+	LineParser::ApplyOperator()
+
+	Calls an operator handler, adding it to the expression being compiled if there is one
+
+	@param		handler			The operator handler
+	@param		recording		If not NULL, the expression being compiled
+*/
+/*************************************************************************************************/
+void LineParser::ApplyOperator( OperatorHandler handler, CompiledExpression* recording )
+{
+	if ( recording != NULL )
+	{
+		// The compiled expression refers to the operator by its index in the operator tables
+
+		bool bFound = false;
+
+		for ( unsigned int i = 0; i < sizeof m_gaUnaryOperatorTable / sizeof(Operator) && !bFound; i++ )
+		{
+			if ( m_gaUnaryOperatorTable[ i ].handler == handler )
+			{
+				recording->AddOp( CompiledExpression::UNARY_OPERATOR, m_column, i );
+				bFound = true;
+			}
+		}
+
+		for ( unsigned int i = 0; i < sizeof m_gaBinaryOperatorTable / sizeof(Operator) && !bFound; i++ )
+		{
+			if ( m_gaBinaryOperatorTable[ i ].handler == handler )
+			{
+				recording->AddOp( CompiledExpression::BINARY_OPERATOR, m_column, i );
+				bFound = true;
+			}
+		}
+
+		assert( bFound );
+	}
+
+	( this->*handler )();
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::RunCompiledExpression()
+
+	Evaluates a previously compiled expression, leaving the string pointer after it exactly as
+	parsing it would have done, and reporting any errors at the same columns
+
+	@param		result			Receives the value
+	@param		expression		The compiled expression
+
+	@return		false if a symbol was undefined, whose column is left in m_undefinedSymbolColumn
+*/
+/*************************************************************************************************/
+bool LineParser::RunCompiledExpression( Value& result, const CompiledExpression& expression )
+{
+	m_valueStackPtr = 0;
+	m_operatorStackPtr = 0;
+
+	const vector<CompiledExpression::Op>& ops = expression.GetOps();
+
+	for ( vector<CompiledExpression::Op>::const_iterator it = ops.begin(); it != ops.end(); ++it )
+	{
+		const CompiledExpression::Op& op = *it;
+		m_column = op.m_column;
+
+		switch ( op.m_type )
+		{
+			case CompiledExpression::PUSH_VALUE:
+
+				m_valueStack[ m_valueStackPtr++ ] = op.m_value;
+				break;
+
+			case CompiledExpression::PUSH_PC:
+
+				m_valueStack[ m_valueStackPtr++ ] = static_cast< double >( m_context.GetObjectCode().GetPC() );
+				break;
+
+			case CompiledExpression::PUSH_TIME:
+
+				m_valueStack[ m_valueStackPtr++ ] = FormatAssemblyTime("%a,%d %b %Y.%H:%M:%S");
+				break;
+
+			case CompiledExpression::PUSH_SYMBOL:
+			{
+				Value value;
+
+				if ( !m_sourceCode->GetSymbolValue( op.m_nameId, value ) )
+				{
+					// As in ParseExpression, on the first pass move beyond the expression
+
+					m_column = op.m_endColumn;
+					m_undefinedSymbolColumn = op.m_column;
+
+					if ( m_context.GetGlobalData().IsFirstPass() )
+					{
+						SkipExpression( op.m_index, expression.AllowsOneMismatchedCloseBracket() );
+					}
+
+					return false;
+				}
+
+				m_valueStack[ m_valueStackPtr++ ] = value;
+				break;
+			}
+
+			case CompiledExpression::UNARY_OPERATOR:
+
+				( this->*m_gaUnaryOperatorTable[ op.m_index ].handler )();
+				break;
+
+			case CompiledExpression::BINARY_OPERATOR:
+
+				( this->*m_gaBinaryOperatorTable[ op.m_index ].handler )();
+				break;
+		}
+	}
+
+	assert( m_valueStackPtr == 1 );
+
+	m_column = expression.GetEndColumn();
+	result = m_valueStack[ 0 ];
+	return true;
 }
 
+
+
 /*************************************************************************************************/
 /**
 	LineParser::EvaluateExpressionAsDouble()
@@ -1410,13 +1732,19 @@ void LineParser::EvalRnd()
 	{
 		throw AsmException_SyntaxError_IllegalOperation( m_line, m_column - 1 );
 	}
-	else if ( val == 1.0f )
+
+	if ( !m_context.GetRandom().IsRepeatable() )
+	{
+		m_context.NoteUnrepeatable();
+	}
+
+	if ( val == 1.0f )
 	{
-		result = beebasm_rand() / ( static_cast< double >( BEEBASM_RAND_MAX ) + 1.0 );
+		result = m_context.GetRandom().Next() / ( static_cast< double >( BEEBASM_RAND_MAX ) + 1.0 );
 	}
 	else
 	{
-		result = static_cast< double >( ConvertDoubleToInt( beebasm_rand() / ( static_cast< double >( BEEBASM_RAND_MAX ) + 1.0 ) * val ) );
+		result = static_cast< double >( ConvertDoubleToInt( m_context.GetRandom().Next() / ( static_cast< double >( BEEBASM_RAND_MAX ) + 1.0 ) * val ) );
 	}
 
 	m_valueStack[ m_valueStackPtr - 1 ] = result;
@@ -1444,9 +1772,16 @@ void LineParser::EvalTime()
 Value LineParser::FormatAssemblyTime(const char* formatString)
 {
 	char timeString[256];
-	const time_t t = GlobalData::Instance().GetAssemblyTime();
-	const struct tm* t_tm = localtime( &t );
-	int length = strftime( timeString, sizeof( timeString ), formatString, t_tm );
+	const time_t t = m_context.GetGlobalData().GetAssemblyTime();
+	m_context.NoteUnrepeatable();
+	struct tm t_tm;
+	{
+		// localtime() returns a buffer shared by every thread
+		static mutex localTimeMutex;
+		lock_guard< mutex > lock( localTimeMutex );
+		t_tm = *localtime( &t );
+	}
+	int length = strftime( timeString, sizeof( timeString ), formatString, &t_tm );
 	if ( length == 0 )
 	{
 		throw AsmException_SyntaxError_TimeResultTooBig( m_line, m_column );
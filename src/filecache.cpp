@@ -0,0 +1,698 @@
+/*************************************************************************************************/
+/**
+	filecache.cpp
+
+	Keeps the files read during assembly in memory
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <system_error>
+#include <sys/stat.h>
+
+#include "filecache.h"
+#include "stringutils.h"
+
+
+using namespace std;
+
+
+FileCache* FileCache::m_gInstance = NULL;
+
+
+// The number of threads reading files in the background
+static const unsigned int MAX_PREFETCH_THREADS = 4;
+
+// How long, in seconds, a file read in the background is kept for if nothing asks for it, and
+// before a file which has been prefetched can be prefetched again
+static const long long PREFETCH_EXPIRY = 30;
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::NormaliseSource()
+
+	Converts tabs to spaces and normalises line endings (\r, \r\n or \n) to \n, making sure the
+	text ends with a \n.  The runs of text between the characters which need changing are copied
+	in one go, so a file with Unix line endings and no tabs is copied straight across.
+
+	@param		raw				The contents of a source file
+	@returns	string			The normalised text
+*/
+/*************************************************************************************************/
+string FileCache::NormaliseSource( const string& raw )
+{
+	string text;
+	text.reserve( raw.length() + 1 );	// extra 1 for trailing '\n'
+
+	const char* p = raw.data();
+	const char* end = p + raw.length();
+
+	if ( memchr( p, '\t', raw.length() ) == NULL && memchr( p, '\r', raw.length() ) == NULL )
+	{
+		text.assign( raw );
+	}
+	else
+	{
+		while ( p < end )
+		{
+			const char* q = p;
+			while ( q < end && *q != '\t' && *q != '\r' )
+			{
+				q++;
+			}
+
+			text.append( p, q );
+
+			if ( q == end )
+			{
+				break;
+			}
+
+			if ( *q == '\t' )
+			{
+				text.push_back( ' ' );
+			}
+			else if ( q + 1 == end || q[ 1 ] != '\n' )
+			{
+				// a lone \r; a \r\n just loses the \r
+				text.push_back( '\n' );
+			}
+
+			p = q + 1;
+		}
+	}
+
+	if ( text.empty() || text[ text.length() - 1 ] != '\n' )
+	{
+		text.push_back( '\n' );
+	}
+
+	return text;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::Create()
+
+	Creates the FileCache singleton
+*/
+/*************************************************************************************************/
+void FileCache::Create()
+{
+	assert( m_gInstance == NULL );
+
+	m_gInstance = new FileCache;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::Destroy()
+
+	Destroys the FileCache singleton
+*/
+/*************************************************************************************************/
+void FileCache::Destroy()
+{
+	assert( m_gInstance != NULL );
+
+	delete m_gInstance;
+	m_gInstance = NULL;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::FileCache()
+
+	FileCache constructor; starts the prefetch threads
+*/
+/*************************************************************************************************/
+FileCache::FileCache()
+	:	m_stopping( false )
+{
+	unsigned int numThreads = thread::hardware_concurrency();
+
+	if ( numThreads == 0 || numThreads > MAX_PREFETCH_THREADS )
+	{
+		numThreads = MAX_PREFETCH_THREADS;
+	}
+
+	try
+	{
+		for ( unsigned int i = 0; i < numThreads; i++ )
+		{
+			m_prefetchThreads.push_back( thread( &FileCache::PrefetchThread, this ) );
+		}
+	}
+	catch ( system_error& )
+	{
+		// Prefetching is only an optimisation, so carry on with whatever threads we have
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::~FileCache()
+
+	FileCache destructor; stops the prefetch threads
+*/
+/*************************************************************************************************/
+FileCache::~FileCache()
+{
+	{
+		lock_guard< mutex > lock( m_prefetchMutex );
+		m_stopping = true;
+	}
+
+	m_prefetchQueued.notify_all();
+
+	for ( vector< thread >::iterator it = m_prefetchThreads.begin(); it != m_prefetchThreads.end(); ++it )
+	{
+		it->join();
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::ReadFile()
+
+	Reads a whole file, noting its size and modification time.  This is called by the prefetch
+	threads as well as the main thread, so mustn't touch the cache.
+
+	@param		filename		Filename of the file
+	@param		file			Receives the file
+	@returns	bool			false if it couldn't be read
+*/
+/*************************************************************************************************/
+bool FileCache::ReadFile( const string& filename, File& file )
+{
+	long long readTime = static_cast< long long >( time( NULL ) );
+
+	struct stat info;
+
+	if ( stat( filename.c_str(), &info ) != 0 )
+	{
+		return false;
+	}
+
+	ifstream stream;
+	stream.open( filename.c_str(), ios_base::in | ios_base::binary );
+
+	if ( !stream )
+	{
+		return false;
+	}
+
+	string contents;
+	contents.resize( static_cast< size_t >( info.st_size ) );
+
+	if ( !contents.empty() && !stream.read( &contents[ 0 ], contents.length() ) )
+	{
+		return false;
+	}
+
+	// If the file grew while we were reading it, the size and time are out of date anyway, so
+	// it'll be read again next time
+
+	file.m_size = static_cast< long long >( info.st_size );
+	file.m_modified = static_cast< long long >( info.st_mtime );
+	file.m_readTime = readTime;
+	file.m_contents = make_shared< const string >( move( contents ) );
+	file.m_sourceText.reset();
+
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::FindNamedFiles()
+
+	Finds the INCLUDE, INCBIN, PUTFILE, PUTTEXT and PUTBASIC directives in some source text
+	which name a file with a literal string.  This only has to be good enough to find the
+	files which will probably be wanted; it doesn't matter if it finds too many or too few.
+
+	@param		text			The source text
+	@param		files			Receives the filenames, and whether each is a source file
+*/
+/*************************************************************************************************/
+void FileCache::FindNamedFiles( const string& text, FileList& files )
+{
+	static const struct
+	{
+		const char*	m_pName;
+		size_t		m_nameLength;
+		bool		m_isSource;
+	}
+	directives[] =
+	{
+		{ "INCLUDE",	7,	true },
+		{ "INCBIN",		6,	false },
+		{ "PUTFILE",	7,	false },
+		{ "PUTTEXT",	7,	false },
+		{ "PUTBASIC",	8,	false }
+	};
+
+	for ( size_t i = 0; i < text.length(); i++ )
+	{
+		char c = Ascii::ToUpper( text[ i ] );
+
+		if ( ( c != 'I' && c != 'P' ) ||
+			 ( i > 0 && ( Ascii::IsAlpha( text[ i - 1 ] ) || Ascii::IsDigit( text[ i - 1 ] ) || text[ i - 1 ] == '_' ) ) )
+		{
+			continue;
+		}
+
+		for ( size_t d = 0; d < sizeof directives / sizeof directives[ 0 ]; d++ )
+		{
+			size_t j = 0;
+			while ( j < directives[ d ].m_nameLength &&
+					i + j < text.length() &&
+					Ascii::ToUpper( text[ i + j ] ) == directives[ d ].m_pName[ j ] )
+			{
+				j++;
+			}
+
+			if ( j < directives[ d ].m_nameLength )
+			{
+				continue;
+			}
+
+			// the filename must be a single string on its own
+
+			j += i;
+			while ( j < text.length() && text[ j ] == ' ' )
+			{
+				j++;
+			}
+
+			if ( j == text.length() || text[ j ] != '"' )
+			{
+				break;
+			}
+
+			size_t start = j + 1;
+			size_t end = text.find_first_of( "\"\n", start );
+
+			if ( end == string::npos || text[ end ] != '"' || end == start )
+			{
+				break;
+			}
+
+			j = end + 1;
+			while ( j < text.length() && text[ j ] == ' ' )
+			{
+				j++;
+			}
+
+			if ( j == text.length() || strchr( ",:;\\\n", text[ j ] ) != NULL )
+			{
+				files.push_back( make_pair( text.substr( start, end - start ), directives[ d ].m_isSource ) );
+			}
+
+			i = end;
+			break;
+		}
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::FindFile()
+
+	Returns the cached copy of a file, reading it if it isn't cached yet or has changed since it
+	was read
+
+	@param		filename		Filename of the file
+	@returns	File*			The cached file, or NULL if it couldn't be read
+*/
+/*************************************************************************************************/
+FileCache::File* FileCache::FindFile( const string& filename )
+{
+	map< string, File >::iterator it = m_files.find( filename );
+
+	if ( it == m_files.end() )
+	{
+		// A file read in the background may have changed since, so it's checked just like one
+		// which was read here
+
+		File file;
+
+		if ( TakePrefetch( filename, file ) )
+		{
+			it = m_files.insert( make_pair( filename, file ) ).first;
+		}
+	}
+
+	if ( it != m_files.end() )
+	{
+		struct stat info;
+
+		if ( stat( filename.c_str(), &info ) == 0 &&
+			 it->second.m_size == static_cast< long long >( info.st_size ) &&
+			 it->second.m_modified == static_cast< long long >( info.st_mtime ) )
+		{
+			if ( it->second.m_modified < it->second.m_readTime )
+			{
+				return &it->second;
+			}
+
+			// It was modified in the same second as it was read, so it could have been modified
+			// again since without its size or time changing.  Read it again, but if it hasn't
+			// changed keep the same contents, and the source text made from them.
+
+			File file;
+
+			if ( ReadFile( filename, file ) )
+			{
+				if ( *file.m_contents == *it->second.m_contents )
+				{
+					file.m_contents = it->second.m_contents;
+					file.m_sourceText = it->second.m_sourceText;
+				}
+
+				it->second = file;
+				return &it->second;
+			}
+		}
+
+		// Out of date
+
+		m_files.erase( it );
+	}
+
+	File file;
+
+	if ( !ReadFile( filename, file ) )
+	{
+		return NULL;
+	}
+
+	{
+		lock_guard< mutex > lock( m_prefetchMutex );
+		m_prefetchSeen[ filename ] = file.m_readTime;
+	}
+
+	File& newFile = m_files[ filename ];
+	newFile = file;
+	return &newFile;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::GetFile()
+
+	Returns the contents of a file
+
+	@param		filename		Filename of the file
+	@returns	FileContents	Its contents, or NULL if it couldn't be read
+*/
+/*************************************************************************************************/
+FileContents FileCache::GetFile( const string& filename )
+{
+	lock_guard< mutex > lock( m_filesMutex );
+
+	File* file = FindFile( filename );
+
+	return ( file != NULL ) ? file->m_contents : FileContents();
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::GetSourceText()
+
+	Returns the contents of a source file, with tabs converted to spaces and line endings
+	normalised to \n, ending with a \n.  The same text is returned for as long as the file is
+	unchanged.  The first time, the files it names are prefetched.
+
+	@param		filename		Filename of the source file
+	@returns	FileContents	Its text, or NULL if it couldn't be read
+*/
+/*************************************************************************************************/
+FileContents FileCache::GetSourceText( const string& filename )
+{
+	lock_guard< mutex > lock( m_filesMutex );
+
+	File* file = FindFile( filename );
+
+	if ( file == NULL )
+	{
+		return FileContents();
+	}
+
+	if ( !file->m_sourceText )
+	{
+		file->m_sourceText = make_shared< const string >( NormaliseSource( *file->m_contents ) );
+		PrefetchNamedFiles( *file->m_sourceText );
+	}
+
+	return file->m_sourceText;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::PrefetchNamedFiles()
+
+	Starts reading the files named in some source text which aren't already cached
+*/
+/*************************************************************************************************/
+void FileCache::PrefetchNamedFiles( const string& text )
+{
+	if ( m_prefetchThreads.empty() )
+	{
+		return;
+	}
+
+	FileList files;
+	FindNamedFiles( text, files );
+
+	lock_guard< mutex > lock( m_prefetchMutex );
+
+	ExpirePrefetches( static_cast< long long >( time( NULL ) ) );
+
+	for ( FileList::const_iterator it = files.begin(); it != files.end(); ++it )
+	{
+		if ( m_files.find( it->first ) == m_files.end() )
+		{
+			QueuePrefetch( it->first, it->second );
+		}
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::QueuePrefetch()
+
+	Queues a file to be read in the background, unless it has been seen recently.  The prefetch
+	mutex must be held.
+*/
+/*************************************************************************************************/
+void FileCache::QueuePrefetch( const string& filename, bool isSource )
+{
+	long long now = static_cast< long long >( time( NULL ) );
+
+	if ( !m_prefetchSeen.insert( make_pair( filename, now ) ).second )
+	{
+		return;
+	}
+
+	Prefetch& prefetch = m_prefetches[ filename ];
+	prefetch.m_queueTime = now;
+	prefetch.m_state = Prefetch::QUEUED;
+	prefetch.m_isSource = isSource;
+	prefetch.m_ok = false;
+
+	m_prefetchQueue.push_back( filename );
+	m_prefetchQueued.notify_one();
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::ExpirePrefetches()
+
+	Drops the files read in the background which nobody has asked for within PREFETCH_EXPIRY
+	seconds, and forgets the files seen longer ago than that, so that they can be prefetched
+	again.  The prefetch mutex must be held.
+
+	@param		now				The current time
+*/
+/*************************************************************************************************/
+void FileCache::ExpirePrefetches( long long now )
+{
+	for ( map< string, Prefetch >::iterator it = m_prefetches.begin(); it != m_prefetches.end(); )
+	{
+		if ( it->second.m_state == Prefetch::DONE && now - it->second.m_queueTime >= PREFETCH_EXPIRY )
+		{
+			m_prefetches.erase( it++ );
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	for ( map< string, long long >::iterator it = m_prefetchSeen.begin(); it != m_prefetchSeen.end(); )
+	{
+		if ( now - it->second >= PREFETCH_EXPIRY && m_prefetches.find( it->first ) == m_prefetches.end() )
+		{
+			m_prefetchSeen.erase( it++ );
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::TakePrefetch()
+
+	Takes a file which has been read in the background out of the prefetch table.  If it's
+	still being read, waits for it; if it hasn't been started yet, it's left to the caller.
+
+	@param		filename		Filename of the file
+	@param		file			Receives the file
+	@returns	bool			false if the file wasn't prefetched
+*/
+/*************************************************************************************************/
+bool FileCache::TakePrefetch( const string& filename, File& file )
+{
+	unique_lock< mutex > lock( m_prefetchMutex );
+
+	map< string, Prefetch >::iterator it = m_prefetches.find( filename );
+
+	if ( it == m_prefetches.end() )
+	{
+		return false;
+	}
+
+	while ( it->second.m_state == Prefetch::READING )
+	{
+		m_prefetchDone.wait( lock );
+	}
+
+	bool ok = ( it->second.m_state == Prefetch::DONE && it->second.m_ok );
+
+	if ( ok )
+	{
+		file = it->second.m_file;
+	}
+
+	// A queued file is dropped from the table, so the prefetch threads will pass it over
+
+	m_prefetches.erase( it );
+	return ok;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	FileCache::PrefetchThread()
+
+	Reads queued files until the cache is destroyed.  Source files are normalised and scanned
+	for the files they name in turn.
+*/
+/*************************************************************************************************/
+void FileCache::PrefetchThread()
+{
+	unique_lock< mutex > lock( m_prefetchMutex );
+
+	for (;;)
+	{
+		while ( !m_stopping && m_prefetchQueue.empty() )
+		{
+			m_prefetchQueued.wait( lock );
+		}
+
+		if ( m_stopping )
+		{
+			return;
+		}
+
+		string filename = m_prefetchQueue.front();
+		m_prefetchQueue.pop_front();
+
+		map< string, Prefetch >::iterator it = m_prefetches.find( filename );
+
+		if ( it == m_prefetches.end() || it->second.m_state != Prefetch::QUEUED )
+		{
+			continue;
+		}
+
+		it->second.m_state = Prefetch::READING;
+		bool isSource = it->second.m_isSource;
+
+		lock.unlock();
+
+		File file;
+		bool ok = ReadFile( filename, file );
+		FileList files;
+
+		if ( ok && isSource )
+		{
+			file.m_sourceText = make_shared< const string >( NormaliseSource( *file.m_contents ) );
+			FindNamedFiles( *file.m_sourceText, files );
+		}
+
+		lock.lock();
+
+		// Nothing else removes a file while it's being read, so the iterator is still valid
+
+		it->second.m_state = Prefetch::DONE;
+		it->second.m_ok = ok;
+		it->second.m_file = file;
+
+		for ( FileList::const_iterator named = files.begin(); named != files.end(); ++named )
+		{
+			QueuePrefetch( named->first, named->second );
+		}
+
+		m_prefetchDone.notify_all();
+	}
+}
@@ -0,0 +1,129 @@
+/*************************************************************************************************/
+/**
+	filecache.h
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#ifndef FILECACHE_H_
+#define FILECACHE_H_
+
+#include <cassert>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// The contents of a file, shared between everything which reads it
+typedef std::shared_ptr< const std::string > FileContents;
+
+
+// Keeps every file read during assembly (source files, INCLUDEs, INCBIN, PUTFILE, PUTTEXT and
+// PUTBASIC inputs) in memory, so that each is read only once however many times, and in however
+// many passes, it is used.  A file is read again if its size or modification time changes, or
+// if it was modified so recently before it was read that a change might not show in either.
+// The cache is shared by every assembly in the process, which may be running on different
+// threads.
+//
+// Source files are scanned for those directives which name a file with a literal string, and
+// a small pool of threads reads the files they name in the background, so that they're usually
+// in memory by the time the directive is reached.
+class FileCache
+{
+public:
+
+	static void Create();
+	static void Destroy();
+	static inline FileCache& Instance() { assert( m_gInstance != NULL ); return *m_gInstance; }
+
+	FileContents GetFile( const std::string& filename );
+	FileContents GetSourceText( const std::string& filename );
+
+	static std::string NormaliseSource( const std::string& raw );
+
+private:
+
+	FileCache();
+	~FileCache();
+
+	struct File
+	{
+		long long		m_size;
+		long long		m_modified;
+		long long		m_readTime;			// when it was read, to the same resolution as m_modified
+		FileContents	m_contents;
+		FileContents	m_sourceText;		// the contents normalised as source, once asked for
+	};
+
+	// A file named by a directive, which is being read ahead of it being needed
+	struct Prefetch
+	{
+		enum State
+		{
+			QUEUED,
+			READING,
+			DONE
+		};
+
+		State			m_state;
+		long long		m_queueTime;
+		bool			m_isSource;			// read by INCLUDE, so it can be scanned in turn
+		bool			m_ok;
+		File			m_file;
+	};
+
+	typedef std::vector< std::pair< std::string, bool > > FileList;
+
+	static bool ReadFile( const std::string& filename, File& file );
+	static void FindNamedFiles( const std::string& text, FileList& files );
+
+	File* FindFile( const std::string& filename );
+	void PrefetchNamedFiles( const std::string& text );
+	void QueuePrefetch( const std::string& filename, bool isSource );
+	void ExpirePrefetches( long long now );
+	bool TakePrefetch( const std::string& filename, File& file );
+	void PrefetchThread();
+
+	// Only one thread at a time looks up (and if need be reads) files; this mutex is always taken
+	// before m_prefetchMutex
+	std::mutex						m_filesMutex;
+	std::map< std::string, File >	m_files;
+
+	// The prefetch state is shared with the prefetch threads, and guarded by m_prefetchMutex
+	std::mutex							m_prefetchMutex;
+	std::condition_variable				m_prefetchQueued;
+	std::condition_variable				m_prefetchDone;
+	std::deque< std::string >			m_prefetchQueue;
+	std::map< std::string, Prefetch >	m_prefetches;
+	std::map< std::string, long long >	m_prefetchSeen;		// when each file was queued or read, so it isn't queued twice
+	bool								m_stopping;
+	std::vector< std::thread >			m_prefetchThreads;
+
+	static FileCache*				m_gInstance;
+};
+
+
+
+#endif // FILECACHE_H_
@@ -23,43 +23,6 @@
 #include "globaldata.h"
 #include <iostream>
 
-GlobalData* GlobalData::m_gInstance = NULL;
-
-
-
-/*************************************************************************************************/
-/**
-	GlobalData::Create()
-
-	Creates the GlobalData singleton
-*/
-/*************************************************************************************************/
-void GlobalData::Create()
-{
-	assert( m_gInstance == NULL );
-
-	m_gInstance = new GlobalData;
-}
-
-
-
-/*************************************************************************************************/
-/**
-	GlobalData::Destroy()
-
-	Destroys the GlobalData singleton
-*/
-/*************************************************************************************************/
-void GlobalData::Destroy()
-{
-	assert( m_gInstance != NULL );
-
-	delete m_gInstance;
-	m_gInstance = NULL;
-}
-
-
-
 /*************************************************************************************************/
 /**
 	GlobalData::GlobalData()
@@ -78,6 +41,8 @@ GlobalData::GlobalData()
 		m_numAnonSaves( 0 ),
 		m_discOption( 0 ),
 		m_discCycle( 0 ),
+		m_discSides( 1 ),
+		m_discTracks( 80 ),
 		m_assemblyTime( time( NULL ) ),
 		m_bRequireDistinctOpcodes( false ),
 		m_bUseVisualCppErrorFormat( false )
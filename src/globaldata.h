@@ -35,9 +35,8 @@ class GlobalData
 {
 public:
 
-	static void Create();
-	static void Destroy();
-	static inline GlobalData& Instance() { assert( m_gInstance != NULL ); return *m_gInstance; }
+	GlobalData();
+	~GlobalData();
 
 	inline void SetPass( int i )				{ m_pass = i; }
 	inline void SetBootFile( const char* p )	{ m_pBootFile = p; }
@@ -50,6 +49,8 @@ public:
 	inline void IncNumAnonSaves()				{ m_numAnonSaves++; }
 	inline void SetDiscOption( int opt )		{ m_discOption = opt; }
 	inline void SetDiscCycle( int num )		    { m_discCycle = num; }
+	inline void SetDiscSides( int num )			{ m_discSides = num; }
+	inline void SetDiscTracks( int num )		{ m_discTracks = num; }
 	inline void SetDiscTitle( const std::string& t )  
 												{ m_discTitle = t; }
 	inline void SetRequireDistinctOpcodes ( bool b )
@@ -71,6 +72,8 @@ public:
 	inline int GetNumAnonSaves() const			{ return m_numAnonSaves; }
 	inline int GetDiscOption() const			{ return m_discOption; }
 	inline int GetDiscCycle() const			    { return m_discCycle; }
+	inline int GetDiscSides() const				{ return m_discSides; }
+	inline int GetDiscTracks() const			{ return m_discTracks; }
 	inline const std::string& GetDiscTitle() const
 												{ return m_discTitle; }
 	inline time_t GetAssemblyTime() const		{ return m_assemblyTime; }
@@ -79,11 +82,6 @@ public:
 
 private:
 
-	GlobalData();
-	~GlobalData();
-
-	static GlobalData*			m_gInstance;
-
 	int							m_pass;
 	const char*					m_pBootFile;
 	bool						m_bVerboseSet;
@@ -96,6 +94,8 @@ private:
 	int							m_numAnonSaves;
 	int							m_discOption;
 	int							m_discCycle;
+	int							m_discSides;
+	int							m_discTracks;
 	std::string					m_discTitle;
 	time_t						m_assemblyTime;
 	bool						m_bRequireDistinctOpcodes;
@@ -0,0 +1,131 @@
+/*************************************************************************************************/
+/**
+	linecache.cpp
+
+	Caches source lines once they have been split out of their file and lexed
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#include "linecache.h"
+
+
+using namespace std;
+
+
+/*************************************************************************************************/
+/**
+	LineCache::GetLine()
+
+	Returns the lexed line starting at the given offset, splitting it out of the text if this is
+	the first time it has been asked for
+
+	@param		text			The source text the cache belongs to (with a trailing '\n')
+	@param		offset			Offset of the start of the line in the text
+*/
+/*************************************************************************************************/
+LexedLine& LineCache::GetLine( const string& text, int offset )
+{
+	unordered_map< int, LexedLine >::iterator it = m_lines.find( offset );
+	if ( it != m_lines.end() )
+	{
+		return it->second;
+	}
+
+	assert( offset < static_cast< int >( text.length() ) );
+	assert( text.back() == '\n' );
+
+	int end = offset;
+	while ( text[ end ] != '\n' )
+	{
+		end++;
+	}
+
+	LexedLine line( text.substr( offset, end - offset ), end + 1 );
+	return m_lines.insert( make_pair( offset, line ) ).first->second;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineCache::Validate()
+
+	Discards the cached lines if the text has changed since they were lexed.  The cache keeps
+	hold of the text, so that it can be shared by everything which reads the file.
+
+	@param		text			The source text the cache belongs to
+*/
+/*************************************************************************************************/
+void LineCache::Validate( const SourceText& text )
+{
+	if ( m_text != text )
+	{
+		if ( !m_text || *m_text != *text )
+		{
+			m_lines.clear();
+		}
+		m_text = text;
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineCacheTable::LineCacheTable()
+
+	LineCacheTable constructor
+*/
+/*************************************************************************************************/
+LineCacheTable::LineCacheTable()
+{
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineCacheTable::~LineCacheTable()
+
+	LineCacheTable destructor
+*/
+/*************************************************************************************************/
+LineCacheTable::~LineCacheTable()
+{
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineCacheTable::GetFileCache()
+
+	Returns the line cache for a source file, so that the lines lexed on the first pass can be
+	reused on the second
+
+	@param		filename		Filename of the source file
+	@param		text			Its contents
+*/
+/*************************************************************************************************/
+LineCache& LineCacheTable::GetFileCache( const string& filename, const SourceText& text )
+{
+	LineCache& cache = m_map[ filename ];
+	cache.Validate( text );
+	return cache;
+}
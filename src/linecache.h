@@ -0,0 +1,238 @@
+/*************************************************************************************************/
+/**
+	linecache.h
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#ifndef LINECACHE_H_
+#define LINECACHE_H_
+
+#include <cassert>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "value.h"
+
+
+// Source text is held in immutable, reference counted buffers, so that every instance of a
+// macro, and every pass over a file, can share a single copy of it.
+typedef std::shared_ptr< const std::string > SourceText;
+
+
+
+// An expression compiled to reverse Polish form.  It is recorded the first time the expression is
+// successfully evaluated, and thereafter evaluated by running through the operations in turn
+// without parsing the text again.
+class CompiledExpression
+{
+public:
+
+	enum OpType
+	{
+		PUSH_VALUE,			// push a literal value
+		PUSH_PC,			// push the current PC (*)
+		PUSH_TIME,			// push TIME$ with no parameters
+		PUSH_SYMBOL,		// look up and push the value of a symbol
+		UNARY_OPERATOR,		// apply an operator from the unary operator table
+		BINARY_OPERATOR		// apply an operator from the binary operator table
+	};
+
+	struct Op
+	{
+		OpType			m_type;
+		size_t			m_column;		// column at which the operation took place, for error reporting
+		size_t			m_endColumn;	// PUSH_SYMBOL: column following the symbol name
+		int				m_index;		// operator table index, or the bracket depth of a PUSH_SYMBOL
+		Value			m_value;		// PUSH_VALUE: the value
+		int				m_nameId;		// PUSH_SYMBOL: the name of the symbol, in the SymbolNamePool
+	};
+
+	CompiledExpression( size_t column, bool bAllowOneMismatchedCloseBracket )
+		:	m_column( column ),
+			m_endColumn( column ),
+			m_bAllowOneMismatchedCloseBracket( bAllowOneMismatchedCloseBracket )
+	{
+	}
+
+	void AddOp( OpType type, size_t column, int index = 0 )
+	{
+		Op op;
+		op.m_type = type;
+		op.m_column = column;
+		op.m_endColumn = column;
+		op.m_index = index;
+		op.m_nameId = -1;
+		m_ops.push_back( op );
+	}
+
+	void AddValue( const Value& value, size_t column )
+	{
+		AddOp( PUSH_VALUE, column );
+		m_ops.back().m_value = value;
+	}
+
+	void AddSymbol( int nameId, size_t column, size_t endColumn, int bracketCount )
+	{
+		AddOp( PUSH_SYMBOL, column, bracketCount );
+		m_ops.back().m_endColumn = endColumn;
+		m_ops.back().m_nameId = nameId;
+	}
+
+	inline void					SetEndColumn( size_t column )	{ m_endColumn = column; }
+
+	inline size_t				GetColumn() const				{ return m_column; }
+	inline size_t				GetEndColumn() const			{ return m_endColumn; }
+	inline bool					AllowsOneMismatchedCloseBracket() const { return m_bAllowOneMismatchedCloseBracket; }
+	inline const std::vector<Op>& GetOps() const				{ return m_ops; }
+
+private:
+
+	size_t					m_column;
+	size_t					m_endColumn;
+	bool					m_bAllowOneMismatchedCloseBracket;
+	std::vector<Op>			m_ops;
+};
+
+
+
+// A single line of source, split out of its file and lexed the first time it is visited.
+// The same line is seen again on the second pass, on every iteration of an enclosing FOR loop
+// and on every expansion of a macro, so anything which depends only on the text of the line
+// is worked out once and kept here.
+class LexedLine
+{
+public:
+
+	// What we know about the statement starting at a given column
+	struct Statement
+	{
+		size_t	m_column;				// column of the first character of the statement
+		bool	m_isSymbolAssignment;	// symbol followed by '=', which takes priority over tokens
+		int		m_token;				// index into the directive token table, or -1
+		size_t	m_tokenEndColumn;		// column following the directive token
+	};
+
+	// Whether the line has any of the directives which are acted on inside a false IF block
+	enum ConditionalState
+	{
+		CONDITIONAL_UNKNOWN,
+		CONDITIONAL_NONE,
+		CONDITIONAL_SOME
+	};
+
+	LexedLine( const std::string& text, int nextLinePointer )
+		:	m_text( text ),
+			m_nextLinePointer( nextLinePointer ),
+			m_conditionalState( CONDITIONAL_UNKNOWN )
+	{
+	}
+
+	inline const std::string&	GetText() const				{ return m_text; }
+	inline int					GetNextLinePointer() const	{ return m_nextLinePointer; }
+	inline ConditionalState		GetConditionalState() const	{ return m_conditionalState; }
+	inline void					SetConditionalState( ConditionalState state ) { m_conditionalState = state; }
+
+	const Statement* FindStatement( size_t column ) const
+	{
+		for ( std::vector<Statement>::const_iterator it = m_statements.begin(); it != m_statements.end(); ++it )
+		{
+			if ( it->m_column == column )
+			{
+				return &*it;
+			}
+		}
+		return NULL;
+	}
+
+	void AddStatement( const Statement& statement )
+	{
+		assert( FindStatement( statement.m_column ) == NULL );
+		m_statements.push_back( statement );
+	}
+
+	const CompiledExpression* FindExpression( size_t column, bool bAllowOneMismatchedCloseBracket ) const
+	{
+		for ( std::vector<CompiledExpression>::const_iterator it = m_expressions.begin(); it != m_expressions.end(); ++it )
+		{
+			if ( it->GetColumn() == column && it->AllowsOneMismatchedCloseBracket() == bAllowOneMismatchedCloseBracket )
+			{
+				return &*it;
+			}
+		}
+		return NULL;
+	}
+
+	void AddExpression( const CompiledExpression& expression )
+	{
+		assert( FindExpression( expression.GetColumn(), expression.AllowsOneMismatchedCloseBracket() ) == NULL );
+		m_expressions.push_back( expression );
+	}
+
+private:
+
+	std::string						m_text;
+	int								m_nextLinePointer;
+	ConditionalState				m_conditionalState;
+	std::vector<Statement>			m_statements;
+	std::vector<CompiledExpression>	m_expressions;
+};
+
+
+
+// The lexed lines of one piece of source text, keyed by the offset of the start of the line.
+class LineCache
+{
+public:
+
+	LexedLine& GetLine( const std::string& text, int offset );
+
+	void Validate( const SourceText& text );
+
+	inline const SourceText& GetText() const { return m_text; }
+
+private:
+
+	std::unordered_map< int, LexedLine >	m_lines;
+	SourceText								m_text;			// the source file's text, once validated
+};
+
+
+
+// The line caches for source files, which persist between passes.
+class LineCacheTable
+{
+public:
+
+	LineCacheTable();
+	~LineCacheTable();
+
+	LineCache& GetFileCache( const std::string& filename, const SourceText& text );
+
+private:
+
+	std::map< std::string, LineCache >	m_map;
+};
+
+
+
+#endif // LINECACHE_H_
@@ -24,6 +24,7 @@
 
 #include <iostream>
 #include "lineparser.h"
+#include "assemblycontext.h"
 #include "asmexception.h"
 #include "stringutils.h"
 #include "symboltable.h"
@@ -44,13 +45,19 @@ using namespace std;
 /*************************************************************************************************/
 LineParser::LineParser( SourceCode* sourceCode, const string& line )
 	:	m_sourceCode( sourceCode ),
+		m_context( sourceCode->GetContext() ),
 		m_line( line ),
-		m_column( 0 )
+		m_column( 0 ),
+		m_lexedLine( NULL ),
+		m_undefinedSymbolColumn( 0 )
 {
 }
 
 LineParser::LineParser( SourceCode* sourceCode )
-	:	m_sourceCode( sourceCode )
+	:	m_sourceCode( sourceCode ),
+		m_context( sourceCode->GetContext() ),
+		m_lexedLine( NULL ),
+		m_undefinedSymbolColumn( 0 )
 {
 }
 
@@ -74,68 +81,54 @@ LineParser::~LineParser()
 	LineParser::ProcessLine()
 
 	Process one line of the file
+
+	@param		line			The lexed line, which remembers how its statements were classified
 */
 /*************************************************************************************************/
-void LineParser::Process( const string& line )
+void LineParser::Process( LexedLine& line )
 {
-	m_line = line;
+	m_line = line.GetText();
 	m_column = 0;
+	m_lexedLine = &line;
+
+	// Inside a false IF block, lines with none of the directives which open or close a
+	// conditional block or a macro have no effect at all (unless a macro is being recorded),
+	// so skip them without looking at their statements again
+
+	if ( !m_sourceCode->IsIfConditionTrue() && m_sourceCode->GetCurrentMacro() == NULL )
+	{
+		if ( line.GetConditionalState() == LexedLine::CONDITIONAL_UNKNOWN )
+		{
+			line.SetConditionalState( HasConditionalDirective() ? LexedLine::CONDITIONAL_SOME : LexedLine::CONDITIONAL_NONE );
+			m_column = 0;
+		}
+
+		if ( line.GetConditionalState() == LexedLine::CONDITIONAL_NONE )
+		{
+			return;
+		}
+	}
 
 	bool bProcessedSomething = false;
 	while ( AdvanceAndCheckEndOfLine() )	// keep going until we reach the end of the line
 	{
 		bProcessedSomething = true;
-//		cout << m_line << endl << string( m_column, ' ' ) << "^" << endl;
+//		m_context.GetOutput() << m_line << endl << string( m_column, ' ' ) << "^" << endl;
 
 		int oldColumn = m_column;
 
-		// Priority: check if it's symbol assignment and let it take priority over keywords
-		// This means symbols can begin with reserved words, e.g. PLAyer, but in the case of
-		// the line 'player = 1', the meaning is unambiguous, so we allow it as a symbol
-		// assignment.
-
-		bool bIsSymbolAssignment = false;
+		LexedLine::Statement statement = GetStatement();
 
-		if ( Ascii::IsAlpha( m_line[ m_column ] ) || m_line[ m_column ] == '_' )
-		{
-			do
-			{
-				m_column++;
-
-			} while ( m_column < m_line.length() &&
-					  ( Ascii::IsAlpha( m_line[ m_column ] ) ||
-						Ascii::IsDigit( m_line[ m_column ] ) ||
-						m_line[ m_column ] == '_' ||
-						m_line[ m_column ] == '%' ||
-						m_line[ m_column ] == '$' ) &&
-						m_line[ m_column - 1 ] != '%' &&
-						m_line[ m_column - 1 ] != '$' );
-
-			if ( AdvanceAndCheckEndOfStatement() )
-			{
-				if ( m_line[ m_column ] == '=' )
-				{
-					// if we have a valid symbol name, followed by an '=', it is definitely
-					// a symbol assignment.
-					bIsSymbolAssignment = true;
-				}
-			}
-		}
-
-		m_column = oldColumn;
+		bool bIsSymbolAssignment = statement.m_isSymbolAssignment;
 
 		// first check tokens - they have priority over opcodes, so that they can have names
 		// like INCLUDE (which would otherwise be interpreted as INC LUDE)
 
-		if ( !bIsSymbolAssignment )
+		if ( statement.m_token != -1 )
 		{
-			int token = GetTokenAndAdvanceColumn();
-
-			if ( token != -1 )
-			{
-				HandleToken( token, oldColumn );
-				continue;
-			}
+			m_column = statement.m_tokenEndColumn;
+			HandleToken( statement.m_token, oldColumn );
+			continue;
 		}
 
 		// Next we see if we should even be trying to execute anything.... maybe the if condition is false
@@ -188,11 +181,11 @@ void LineParser::Process( const string& line )
 
 			Value value = EvaluateExpression();
 
-			if ( GlobalData::Instance().IsFirstPass() )
+			if ( m_context.GetGlobalData().IsFirstPass() )
 			{
 				// only add the symbol on the first pass
 
-				if ( SymbolTable::Instance().IsSymbolDefined( symbolName ) )
+				if ( m_context.GetSymbolTable().IsSymbolDefined( symbolName ) )
 				{
 					if (!bIsConditionalAssignment)
 					{
@@ -201,7 +194,7 @@ void LineParser::Process( const string& line )
 				}
 				else
 				{
-					SymbolTable::Instance().AddSymbol( symbolName, value );
+					m_context.GetSymbolTable().AddSymbol( symbolName, value );
 				}
 			}
 
@@ -219,12 +212,12 @@ void LineParser::Process( const string& line )
 		if ( Ascii::IsAlpha( m_line[ m_column ] ) || m_line[ m_column ] == '_' )
 		{
 			string macroName = GetSymbolName();
-			const Macro* macro = MacroTable::Instance().Get( macroName );
+			const Macro* macro = m_context.GetMacroTable().Get( macroName );
 			if ( macro != NULL )
 			{
 				if ( m_sourceCode->ShouldOutputAsm() )
 				{
-					cout << "Macro " << macroName << ":" << endl;
+					m_context.GetOutput() << "Macro " << macroName << ":" << endl;
 				}
 
 				// Evaluate parameters at outer scope.
@@ -234,19 +227,7 @@ void LineParser::Process( const string& line )
 				parameterDefined.resize( macro->GetNumberOfParameters() );
 				for ( int i = 0; i < macro->GetNumberOfParameters(); i++ )
 				{
-					try
-					{
-						Value value = EvaluateExpression();
-						parameterValues[i] = value;
-						parameterDefined[i] = true;
-					}
-					catch ( AsmException_SyntaxError_SymbolNotDefined& )
-					{
-						if ( GlobalData::Instance().IsSecondPass() )
-						{
-							throw;
-						}
-					}
+					parameterDefined[i] = TryEvaluateExpression( parameterValues[i] );
 
 					if ( i != macro->GetNumberOfParameters() - 1 )
 					{
@@ -275,15 +256,15 @@ void LineParser::Process( const string& line )
 					if ( parameterDefined[i] )
 					{
 						ScopedSymbolName paramName = m_sourceCode->GetScopedSymbolName( macro->GetParameter( i ) );
-						if ( !SymbolTable::Instance().IsSymbolDefined( paramName ) )
+						if ( !m_context.GetSymbolTable().IsSymbolDefined( paramName ) )
 						{
-							SymbolTable::Instance().AddSymbol( paramName, parameterValues[i] );
+							m_context.GetSymbolTable().AddSymbol( paramName, parameterValues[i] );
 						}
 						else
 						{
 							// The value may come from an outer scope on the first pass and the current scope on
 							// the second pass so it may need updating.
-							SymbolTable::Instance().ChangeSymbol( paramName, parameterValues[i] );
+							m_context.GetSymbolTable().ChangeSymbol( paramName, parameterValues[i] );
 						}
 					}
 				}
@@ -295,7 +276,7 @@ void LineParser::Process( const string& line )
 
 				if ( m_sourceCode->ShouldOutputAsm() )
 				{
-					cout << "End macro " << macroName << endl;
+					m_context.GetOutput() << "End macro " << macroName << endl;
 				}
 
 				continue;
@@ -322,6 +303,127 @@ void LineParser::Process( const string& line )
 
 
 
+/*************************************************************************************************/
+/**
+	LineParser::GetStatement()
+
+	Returns the classification of the statement at the current column.  This depends only on the
+	text of the line, so it is only worked out the first time the statement is reached, and
+	looked up thereafter.
+*/
+/*************************************************************************************************/
+const LexedLine::Statement& LineParser::GetStatement()
+{
+	const LexedLine::Statement* cachedStatement = m_lexedLine->FindStatement( m_column );
+
+	if ( cachedStatement == NULL )
+	{
+		m_lexedLine->AddStatement( ClassifyStatement() );
+		cachedStatement = m_lexedLine->FindStatement( m_column );
+	}
+
+	return *cachedStatement;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::HasConditionalDirective()
+
+	Works out whether any statement on the line is one of the directives which must still be
+	seen inside a false IF block (IF, ELIF, ELSE, ENDIF, MACRO or ENDMACRO).  The statements are
+	stepped through just as they are when they are skipped.
+
+	@return		true if there is one; the column is left at an arbitrary position
+*/
+/*************************************************************************************************/
+bool LineParser::HasConditionalDirective()
+{
+	assert( m_sourceCode->GetCurrentMacro() == NULL );
+
+	m_column = 0;
+
+	while ( AdvanceAndCheckEndOfLine() )
+	{
+		const LexedLine::Statement& statement = GetStatement();
+
+		if ( statement.m_token != -1 && m_gaTokenTable[ statement.m_token ].m_directiveHandler != NULL )
+		{
+			return true;
+		}
+
+		SkipStatement();
+	}
+
+	return false;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	LineParser::ClassifyStatement()
+
+	Works out whether the statement at the current column is a symbol assignment or starts with
+	a directive token.  This depends only on the text of the line, so the result can be cached.
+
+	@return		The classification of the statement; the column is left unchanged
+*/
+/*************************************************************************************************/
+LexedLine::Statement LineParser::ClassifyStatement()
+{
+	LexedLine::Statement statement;
+	statement.m_column = m_column;
+	statement.m_isSymbolAssignment = false;
+	statement.m_token = -1;
+	statement.m_tokenEndColumn = m_column;
+
+	// Priority: check if it's symbol assignment and let it take priority over keywords
+	// This means symbols can begin with reserved words, e.g. PLAyer, but in the case of
+	// the line 'player = 1', the meaning is unambiguous, so we allow it as a symbol
+	// assignment.
+
+	if ( Ascii::IsAlpha( m_line[ m_column ] ) || m_line[ m_column ] == '_' )
+	{
+		do
+		{
+			m_column++;
+
+		} while ( m_column < m_line.length() &&
+				  ( Ascii::IsAlpha( m_line[ m_column ] ) ||
+					Ascii::IsDigit( m_line[ m_column ] ) ||
+					m_line[ m_column ] == '_' ||
+					m_line[ m_column ] == '%' ||
+					m_line[ m_column ] == '$' ) &&
+					m_line[ m_column - 1 ] != '%' &&
+					m_line[ m_column - 1 ] != '$' );
+
+		if ( AdvanceAndCheckEndOfStatement() )
+		{
+			if ( m_line[ m_column ] == '=' )
+			{
+				// if we have a valid symbol name, followed by an '=', it is definitely
+				// a symbol assignment.
+				statement.m_isSymbolAssignment = true;
+			}
+		}
+	}
+
+	m_column = statement.m_column;
+
+	if ( !statement.m_isSymbolAssignment )
+	{
+		statement.m_token = GetTokenAndAdvanceColumn();
+		statement.m_tokenEndColumn = m_column;
+		m_column = statement.m_column;
+	}
+
+	return statement;
+}
+
+
+
 /*************************************************************************************************/
 /**
 	LineParser::SkipStatement()
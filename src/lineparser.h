@@ -24,9 +24,12 @@
 #define LINEPARSER_H_
 
 #include <string>
+#include <vector>
 #include "objectcode.h"
 #include "value.h"
+#include "linecache.h"
 
+class AssemblyContext;
 class SourceCode;
 
 class LineParser
@@ -41,7 +44,7 @@ public:
 
 	// Process the given line
 
-	void Process( const std::string& line );
+	void Process( LexedLine& line );
 
 	// Accessors
 
@@ -59,6 +62,17 @@ private:
 		DirectiveHandler	m_directiveHandler;
 	};
 
+	// m_gaTokenTable indexed by the first character of each token, so that a statement is only
+	// compared against the tokens it could match.  Within each character, tokens stay in table
+	// order, which gives them their priority (e.g. SKIPTO before SKIP).
+	struct TokenIndex
+	{
+		TokenIndex();
+
+		std::vector<int>	m_tokens;				// token table indices, sorted by first character
+		size_t				m_start[ 257 ];			// where each character's tokens start in m_tokens
+	};
+
 	enum ADDRESSING_MODE
 	{
 		IMP,
@@ -88,6 +102,17 @@ private:
 		int				m_cpu;
 	};
 
+	// m_gaOpcodeTable indexed by mnemonic, packed into an integer 5 bits per letter, with a
+	// table for each CPU so that instructions it doesn't support aren't found
+	struct OpcodeIndex
+	{
+		OpcodeIndex();
+
+		static int	PackMnemonic( char c1, char c2, char c3 );
+
+		signed char	m_opcodes[ CPU_65C02 + 1 ][ 1 << 15 ];	// opcode table index, or -1
+	};
+
 
 	typedef void ( LineParser::*OperatorHandler )();
 
@@ -117,6 +142,9 @@ private:
 	bool			AdvanceAndCheckEndOfLine();
 	bool			AdvanceAndCheckEndOfStatement();
 	bool			AdvanceAndCheckEndOfSubStatement(bool includeComma);
+	const LexedLine::Statement&	GetStatement();
+	LexedLine::Statement	ClassifyStatement();
+	bool			HasConditionalDirective();
 	void			SkipStatement();
 	void			SkipExpression( int bracketCount, bool bAllowOneMismatchedCloseBracket );
 	std::string		GetSymbolName();
@@ -147,6 +175,7 @@ private:
 	void			HandleEqud();
 	void			HandleAssert();
 	void			HandleSave();
+	void			HandleLoadOrder();
 	void			HandleFor();
 	void			HandleNext();
 	void			HandleOpenBrace();
@@ -177,7 +206,14 @@ private:
 	int				EvaluateExpressionAsInt( bool bAllowOneMismatchedCloseBracket = false );
 	unsigned int	EvaluateExpressionAsUnsignedInt( bool bAllowOneMismatchedCloseBracket = false );
 	std::string		EvaluateExpressionAsString( bool bAllowOneMismatchedCloseBracket = false );
-	Value			GetValue();
+	bool			TryEvaluateExpression( Value& value, bool bAllowOneMismatchedCloseBracket = false );
+	bool			TryEvaluateExpressionAsInt( int& value, bool bAllowOneMismatchedCloseBracket = false );
+	bool			TryEvaluateExpressionAsUnsignedInt( unsigned int& value, bool bAllowOneMismatchedCloseBracket = false );
+	bool			EvaluateExpressionIfDefined( Value& value, bool bAllowOneMismatchedCloseBracket );
+	bool			GetValue( Value& value, int bracketCount, CompiledExpression* recording );
+	bool			ParseExpression( Value& result, bool bAllowOneMismatchedCloseBracket, CompiledExpression* recording );
+	bool			RunCompiledExpression( Value& result, const CompiledExpression& expression );
+	void			ApplyOperator( OperatorHandler handler, CompiledExpression* recording );
 
 	// convenience functions for getting operator parameters from the stack
 	std::pair<Value, Value> StackTopTwoValues();
@@ -246,11 +282,16 @@ private:
 	Value			FormatAssemblyTime(const char* formatString);
 
 	SourceCode*				m_sourceCode;
+	AssemblyContext&		m_context;
 	std::string				m_line;
 	size_t					m_column;
+	LexedLine*				m_lexedLine;		// the cached line being parsed, or NULL if there isn't one
+	size_t					m_undefinedSymbolColumn;	// where the last undefined symbol was found
 
 	static const Token		m_gaTokenTable[];
+	static const TokenIndex	m_gTokenIndex;
 	static const OpcodeData	m_gaOpcodeTable[];
+	static const OpcodeIndex	m_gOpcodeIndex;
 	static const Operator	m_gaUnaryOperatorTable[];
 	static const Operator	m_gaBinaryOperatorTable[];
 
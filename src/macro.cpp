@@ -27,9 +27,6 @@
 using namespace std;
 
 
-MacroTable* MacroTable::m_gInstance = NULL;
-
-
 /*************************************************************************************************/
 /**
 	Macro::Macro()
@@ -42,7 +39,8 @@ MacroTable* MacroTable::m_gInstance = NULL;
 /*************************************************************************************************/
 Macro::Macro( const string& filename, int lineNumber )
 	:	m_filename( filename ),
-		m_lineNumber( lineNumber )
+		m_lineNumber( lineNumber ),
+		m_body( make_shared< string >() )
 {
 }
 
@@ -58,47 +56,10 @@ Macro::Macro( const string& filename, int lineNumber )
 */
 /*************************************************************************************************/
 MacroInstance::MacroInstance( const Macro* macro, const SourceCode* sourceCode )
-	:	SourceCode( macro->GetFilename(), macro->GetLineNumber(), macro->GetBody(), sourceCode )
+	:	SourceCode( sourceCode->GetContext(), macro->GetFilename(), macro->GetLineNumber(), macro->GetBody(), macro->GetLineCache(), sourceCode )
 		//,m_macro( macro )
 {
 //	cout << "Instance macro: " << m_macro->GetName() << " (" << m_filename << ":" << m_lineNumber << ")" << endl;
-
-	// Copy FOR stack from the parent
-
-	CopyForStack( sourceCode );
-}
-
-
-
-/*************************************************************************************************/
-/**
-	MacroTable::Create()
-
-	Creates the MacroTable singleton
-*/
-/*************************************************************************************************/
-void MacroTable::Create()
-{
-	assert( m_gInstance == NULL );
-
-	m_gInstance = new MacroTable;
-}
-
-
-
-/*************************************************************************************************/
-/**
-	MacroTable::Destroy()
-
-	Destroys the MacroTable singleton
-*/
-/*************************************************************************************************/
-void MacroTable::Destroy()
-{
-	assert( m_gInstance != NULL );
-
-	delete m_gInstance;
-	m_gInstance = NULL;
 }
 
 
@@ -26,9 +26,11 @@
 #include <cassert>
 #include <cstdlib>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include "sourcecode.h"
+#include "linecache.h"
 
 
 class Macro
@@ -50,7 +52,7 @@ public:
 
 	void AddLine( const std::string& line )
 	{
-		m_body += line;
+		*m_body += line;
 	}
 
 	const std::string& GetName() const
@@ -68,7 +70,7 @@ public:
 		return m_parameters[ i ];
 	}
 
-	const std::string& GetBody() const
+	SourceText GetBody() const
 	{
 		return m_body;
 	}
@@ -83,6 +85,11 @@ public:
 		return m_lineNumber;
 	}
 
+	LineCache& GetLineCache() const
+	{
+		return m_lineCache;
+	}
+
 
 private:
 
@@ -91,7 +98,12 @@ private:
 
 	std::string						m_name;
 	std::vector< std::string >		m_parameters;
-	std::string						m_body;
+	// The body only grows while the macro is being defined, before it can be instanced; after
+	// that every instance shares it
+	std::shared_ptr< std::string >	m_body;
+
+	// Lexed lines of the body, shared by every instance of the macro
+	mutable LineCache				m_lineCache;
 
 };
 
@@ -110,9 +122,8 @@ class MacroTable
 {
 public:
 
-	static void Create();
-	static void Destroy();
-	static inline MacroTable& Instance() { assert( m_gInstance != NULL ); return *m_gInstance; }
+	MacroTable();
+	~MacroTable();
 
 	void Add( Macro* macro );
 	bool Exists( const std::string& name ) const;
@@ -120,12 +131,7 @@ public:
 
 private:
 
-	MacroTable();
-	~MacroTable();
-
 	std::map< std::string, Macro* >	m_map;
-
-	static MacroTable*				m_gInstance;
 };
 
 
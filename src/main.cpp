@@ -22,45 +22,128 @@
 */
 /*************************************************************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <fstream>
 #include <cstring>
 #include <cstdlib>
 #include <ctime>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "main.h"
+#include "assemblycontext.h"
+#include "buildcache.h"
 #include "sourcefile.h"
 #include "asmexception.h"
 #include "globaldata.h"
 #include "objectcode.h"
+#include "outputfile.h"
 #include "symboltable.h"
+#include "symbolnamepool.h"
 #include "discimage.h"
-#include "macro.h"
+#include "filecache.h"
 #include "random.h"
+#include "stringutils.h"
 #include "version.h"
 
 
 using namespace std;
 
 
+// How often -watch checks whether the files read have changed
+static const int WATCH_POLL_INTERVAL_MS = 200;
+
+
+// The options of a single assembly which aren't held in its AssemblyContext
+struct Options
+{
+	Options()
+		:	m_pInputFile( NULL ),
+			m_pDiscInputFile( NULL ),
+			m_pDiscOutputFile( NULL ),
+			m_pLabelsOutputFile( NULL ),
+			m_pDepFile( NULL ),
+			m_pCacheDirectory( NULL ),
+			m_pBatchFile( NULL ),
+			m_numBatchThreads( 0 ),
+			m_bDumpSymbols( false ),
+			m_bDumpAllSymbols( false ),
+			m_bWatch( false )
+	{
+	}
+
+	const char*		m_pInputFile;
+	const char*		m_pDiscInputFile;
+	const char*		m_pDiscOutputFile;
+	const char*		m_pLabelsOutputFile;
+	const char*		m_pDepFile;
+	const char*		m_pCacheDirectory;
+	BuildCache::Hash	m_commandKey;		// hash of the parameters other than -cache
+	const char*		m_pBatchFile;
+	int				m_numBatchThreads;		// 0 to use one per hardware thread
+	bool			m_bDumpSymbols;
+	bool			m_bDumpAllSymbols;
+	bool			m_bWatch;
+};
+
+
+
+// One assembly in a batch: a line of the manifest
+struct BatchJob
+{
+	explicit BatchJob( int lineNumber ) : m_lineNumber( lineNumber ), m_exitCode( EXIT_FAILURE ), m_bDone( false ) {}
+
+	int							m_lineNumber;
+	std::vector< std::string >	m_args;
+	std::ostringstream			m_output;
+	std::ostringstream			m_errors;
+	int							m_exitCode;
+	bool						m_bDone;
+};
+
+
+
+// The jobs of a batch, and the state shared by the threads running them
+struct Batch
+{
+	Batch() : m_nextJob( 0 ) {}
+
+	std::vector< const char* >						m_commonArgs;	// from the command line, for every job
+	std::vector< std::unique_ptr< BatchJob > >		m_jobs;
+	std::atomic< size_t >							m_nextJob;
+	std::mutex										m_mutex;		// guards m_bDone of each job
+	std::condition_variable							m_jobDone;
+};
+
+
+
 /*************************************************************************************************/
 /**
-	main()
+	ParseOptions()
 
-	The main entry point for the application
+	Parses command line parameters into the context of an assembly and its options
 
-	@param		argc			Number of parameters passed
+	@param		argc			Number of parameters
 	@param		argv			Array of parameters
+	@param		context			The assembly
+	@param		options			Receives the options which aren't held in the context
+	@param		pCommonArgs		If not NULL, batch and watch modes are allowed, and the parameters
+								other than those to do with the batch are added to this
+	@param		exitCode		If the parameters say not to assemble, receives the exit code
+	@returns	bool			false if the program should exit without assembling
 */
 /*************************************************************************************************/
-
-int main( int argc, char* argv[] )
+static bool ParseOptions( int argc, const char* const argv[], AssemblyContext& context, Options& options,
+						  vector< const char* >* pCommonArgs, int& exitCode )
 {
-	const char* pInputFile = NULL;
-	const char* pOutputFile = NULL;
-	const char* pDiscInputFile = NULL;
-	const char* pDiscOutputFile = NULL;
-	const char* pLabelsOutputFile = NULL;
-
 	enum STATES
 	{
 		READY,
@@ -72,27 +155,60 @@ int main( int argc, char* argv[] )
 		WAITING_FOR_DISC_OPTION,
 		WAITING_FOR_DISC_TITLE,
 		WAITING_FOR_DISC_CYCLE,
+		WAITING_FOR_DISC_SIDES,
+		WAITING_FOR_DISC_TRACKS,
 		WAITING_FOR_SYMBOL,
 		WAITING_FOR_STRING_SYMBOL,
-		WAITING_FOR_LABELS_FILE
+		WAITING_FOR_LABELS_FILE,
+		WAITING_FOR_DEP_FILE,
+		WAITING_FOR_CACHE_DIRECTORY,
+		WAITING_FOR_BATCH_FILE,
+		WAITING_FOR_BATCH_THREADS
 
 	} state = READY;
 
-	bool bDumpSymbols = false;
-	bool bDumpAllSymbols = false;
+	ostream& errors = context.GetErrors();
+	exitCode = EXIT_FAILURE;
 
-	GlobalData::Create();
-	SymbolTable::Create();
+	// The build cache knows the assembly by all of its parameters, other than where the cache
+	// and the dependency file are, which don't affect what's assembled
 
-	// Parse command line parameters
+	options.m_commandKey = BuildCache::HashString( VERSION );
+
+	for ( int i = 0; i < argc; i++ )
+	{
+		if ( ( strcmp( argv[i], "-cache" ) == 0 || strcmp( argv[i], "-dep" ) == 0 ) && i + 1 < argc )
+		{
+			i++;
+		}
+		else
+		{
+			options.m_commandKey = BuildCache::HashString( argv[i], options.m_commandKey );
+		}
+	}
 
-	for ( int i = 1; i < argc; i++ )
+	for ( int i = 0; i < argc; i++ )
 	{
 		switch ( state )
 		{
 			case READY:
 
-				if ( strcmp( argv[i], "-i" ) == 0 )
+				if ( pCommonArgs != NULL && strcmp( argv[i], "-batch" ) == 0 )
+				{
+					state = WAITING_FOR_BATCH_FILE;
+					continue;
+				}
+				else if ( pCommonArgs != NULL && strcmp( argv[i], "-j" ) == 0 )
+				{
+					state = WAITING_FOR_BATCH_THREADS;
+					continue;
+				}
+				else if ( pCommonArgs != NULL && strcmp( argv[i], "-watch" ) == 0 )
+				{
+					options.m_bWatch = true;
+					continue;
+				}
+				else if ( strcmp( argv[i], "-i" ) == 0 )
 				{
 					state = WAITING_FOR_INPUT_FILENAME;
 				}
@@ -116,6 +232,14 @@ int main( int argc, char* argv[] )
 				{
 					state = WAITING_FOR_LABELS_FILE;
 				}
+				else if ( strcmp( argv[i], "-dep" ) == 0 )
+				{
+					state = WAITING_FOR_DEP_FILE;
+				}
+				else if ( strcmp( argv[i], "-cache" ) == 0 )
+				{
+					state = WAITING_FOR_CACHE_DIRECTORY;
+				}
 				else if ( strcmp( argv[i], "-opt" ) == 0 )
 				{
 					state = WAITING_FOR_DISC_OPTION;
@@ -128,29 +252,37 @@ int main( int argc, char* argv[] )
 				{
 					state = WAITING_FOR_DISC_CYCLE;
 				}
+				else if ( strcmp( argv[i], "-sides" ) == 0 )
+				{
+					state = WAITING_FOR_DISC_SIDES;
+				}
+				else if ( strcmp( argv[i], "-tracks" ) == 0 )
+				{
+					state = WAITING_FOR_DISC_TRACKS;
+				}
 				else if ( strcmp( argv[i], "-w" ) == 0 )
 				{
-					GlobalData::Instance().SetRequireDistinctOpcodes( true );
+					context.GetGlobalData().SetRequireDistinctOpcodes( true );
 				}
 				else if ( strcmp( argv[i], "-vc" ) == 0 )
 				{
-					GlobalData::Instance().SetUseVisualCppErrorFormat( true );
+					context.GetGlobalData().SetUseVisualCppErrorFormat( true );
 				}
 				else if ( strcmp( argv[i], "-v" ) == 0 )
 				{
-					GlobalData::Instance().SetVerbose( true );
+					context.GetGlobalData().SetVerbose( true );
 				}
 				else if ( strcmp( argv[i], "-q" ) == 0 )
 				{
-					GlobalData::Instance().SetVerbose( false );
+					context.GetGlobalData().SetVerbose( false );
 				}
 				else if ( strcmp( argv[i], "-d" ) == 0 )
 				{
-					bDumpSymbols = true;
+					options.m_bDumpSymbols = true;
 				}
 				else if ( strcmp( argv[i], "-dd" ) == 0 )
 				{
-					bDumpAllSymbols = true;
+					options.m_bDumpAllSymbols = true;
 				}
 				else if ( strcmp( argv[i], "-D" ) == 0 )
 				{
@@ -172,9 +304,13 @@ int main( int argc, char* argv[] )
 					cout << " -do <file>     Specify a disc image file to output" << endl;
 					cout << " -boot <file>   Specify a filename to be run by !BOOT on a new disc image" << endl;
 					cout << " -labels <file> Specify a filename to export any labels dumped with -d or -dd to" << endl;
+					cout << " -dep <file>    Write a makefile rule listing the files read and written to a file" << endl;
+					cout << " -cache <dir>   Reuse the results of an identical earlier assembly kept in a directory" << endl;
 					cout << " -opt <opt>     Specify the *OPT 4,n for the generated disc image" << endl;
 					cout << " -title <title> Specify the title for the generated disc image" << endl;
 					cout << " -cycle <n>     Specify the cycle for the generated disc image" << endl;
+					cout << " -sides <n>     Specify 1 (.ssd) or 2 (interleaved .dsd) sides for the disc images" << endl;
+					cout << " -tracks <n>    Specify 40 or 80 tracks for the disc images" << endl;
 					cout << " -v             Verbose output" << endl;
 					cout << " -d             Dump all global symbols after assembly" << endl;
 					cout << " -dd            Dump all global and local symbols after assembly" << endl;
@@ -182,57 +318,60 @@ int main( int argc, char* argv[] )
 					cout << " -vc            Use Visual C++-style error messages" << endl;
 					cout << " -D <sym>=<val> Define numeric symbol prior to assembly" << endl;
 					cout << " -S <sym>=<str> Define string symbol prior to assembly" << endl;
+					cout << " -batch <file>  Run the assemblies listed in a manifest file, one per line, at once" << endl;
+					cout << " -j <n>         Specify the number of assemblies run at once by -batch" << endl;
+					cout << " -watch         Assemble again whenever a file read by the assembly changes" << endl;
 					cout << " --help         See this help again" << endl;
-					return EXIT_SUCCESS;
+					exitCode = EXIT_SUCCESS;
+					return false;
 				}
 				else
 				{
-					cerr << "Bad parameter: " << argv[i] << endl;
-					cerr << "Type beebasm --help for options" << endl;
-					return EXIT_FAILURE;
+					errors << "Bad parameter: " << argv[i] << endl;
+					errors << "Type beebasm --help for options" << endl;
+					return false;
 				}
 				break;
 
 
 			case WAITING_FOR_INPUT_FILENAME:
 
-				pInputFile = argv[i];
+				options.m_pInputFile = argv[i];
 				state = READY;
 				break;
 
 
 			case WAITING_FOR_OUTPUT_FILENAME:
 
-				pOutputFile = argv[i];
-				GlobalData::Instance().SetOutputFile( pOutputFile );
+				context.GetGlobalData().SetOutputFile( argv[i] );
 				state = READY;
 				break;
 
 
 			case WAITING_FOR_DISC_OUTPUT_FILENAME:
 
-				pDiscOutputFile = argv[i];
-				GlobalData::Instance().SetUseDiscImage( true );
+				options.m_pDiscOutputFile = argv[i];
+				context.GetGlobalData().SetUseDiscImage( true );
 				state = READY;
 				break;
 
 
 			case WAITING_FOR_DISC_INPUT_FILENAME:
 
-				pDiscInputFile = argv[i];
+				options.m_pDiscInputFile = argv[i];
 				state = READY;
 				break;
 
 
 			case WAITING_FOR_BOOT_FILENAME:
 
-				GlobalData::Instance().SetBootFile( argv[i] );
+				context.GetGlobalData().SetBootFile( argv[i] );
 				state = READY;
 				break;
 
 			case WAITING_FOR_DISC_OPTION:
 
-				GlobalData::Instance().SetDiscOption( std::strtol( argv[i], NULL, 10 ) );
+				context.GetGlobalData().SetDiscOption( std::strtol( argv[i], NULL, 10 ) );
 				state = READY;
 				break;
 
@@ -240,121 +379,835 @@ int main( int argc, char* argv[] )
 
 				if ( strlen( argv[i] ) > 12 )
 				{
-					cerr << "Disc title cannot be longer than 12 characters" << endl;
-					return EXIT_FAILURE;
+					errors << "Disc title cannot be longer than 12 characters" << endl;
+					return false;
 				}
-				GlobalData::Instance().SetDiscTitle( argv[i] );
+				context.GetGlobalData().SetDiscTitle( argv[i] );
 				state = READY;
                                 break;
 
 			case WAITING_FOR_DISC_CYCLE:
 
-				GlobalData::Instance().SetDiscCycle( std::strtol( argv[i], NULL, 10 ) );
+				context.GetGlobalData().SetDiscCycle( std::strtol( argv[i], NULL, 10 ) );
+				state = READY;
+				break;
+
+			case WAITING_FOR_DISC_SIDES:
+
+				if ( strcmp( argv[i], "1" ) != 0 && strcmp( argv[i], "2" ) != 0 )
+				{
+					errors << "Disc sides must be 1 or 2" << endl;
+					return false;
+				}
+				context.GetGlobalData().SetDiscSides( std::strtol( argv[i], NULL, 10 ) );
+				state = READY;
+				break;
+
+			case WAITING_FOR_DISC_TRACKS:
+
+				if ( strcmp( argv[i], "40" ) != 0 && strcmp( argv[i], "80" ) != 0 )
+				{
+					errors << "Disc tracks must be 40 or 80" << endl;
+					return false;
+				}
+				context.GetGlobalData().SetDiscTracks( std::strtol( argv[i], NULL, 10 ) );
 				state = READY;
 				break;
 
 			case WAITING_FOR_SYMBOL:
 
-				if ( ! SymbolTable::Instance().AddCommandLineSymbol( argv[i] ) )
+				if ( ! context.GetSymbolTable().AddCommandLineSymbol( argv[i] ) )
 				{
-					cerr << "Invalid -D expression: " << argv[i] << endl;
-					return EXIT_FAILURE;
+					errors << "Invalid -D expression: " << argv[i] << endl;
+					return false;
 				}
 				state = READY;
 				break;
 
 			case WAITING_FOR_STRING_SYMBOL:
 
-				if ( ! SymbolTable::Instance().AddCommandLineStringSymbol( argv[i] ) )
+				if ( ! context.GetSymbolTable().AddCommandLineStringSymbol( argv[i] ) )
 				{
-					cerr << "Invalid -S expression: " << argv[i] << endl;
-					return EXIT_FAILURE;
+					errors << "Invalid -S expression: " << argv[i] << endl;
+					return false;
 				}
 				state = READY;
 				break;
 
 			case WAITING_FOR_LABELS_FILE:
 
-				pLabelsOutputFile = argv[i];
+				options.m_pLabelsOutputFile = argv[i];
+				state = READY;
+				break;
+
+			case WAITING_FOR_DEP_FILE:
+
+				options.m_pDepFile = argv[i];
 				state = READY;
 				break;
+
+			case WAITING_FOR_CACHE_DIRECTORY:
+
+				options.m_pCacheDirectory = argv[i];
+				state = READY;
+				break;
+
+			case WAITING_FOR_BATCH_FILE:
+
+				options.m_pBatchFile = argv[i];
+				state = READY;
+				continue;
+
+			case WAITING_FOR_BATCH_THREADS:
+
+				options.m_numBatchThreads = std::strtol( argv[i], NULL, 10 );
+				if ( options.m_numBatchThreads < 1 )
+				{
+					errors << "Invalid -j thread count: " << argv[i] << endl;
+					return false;
+				}
+				state = READY;
+				continue;
+		}
+
+		if ( pCommonArgs != NULL )
+		{
+			pCommonArgs->push_back( argv[i] );
 		}
 	}
 
 	if ( state != READY )
 	{
-		cerr << "Parameter error -" << endl;
-		cerr << "Type beebasm --help for syntax" << endl;
-		return EXIT_FAILURE;
+		errors << "Parameter error -" << endl;
+		errors << "Type beebasm --help for syntax" << endl;
+		return false;
 	}
 
 	// Check parameters
 
-	if ( pInputFile == NULL )
+	if ( options.m_pInputFile == NULL && options.m_pBatchFile == NULL )
 	{
-		cerr << "No source file" << endl;
-		return EXIT_FAILURE;
+		errors << "No source file" << endl;
+		return false;
 	}
 
-	if ( ( pDiscInputFile != NULL && pDiscOutputFile == NULL ) ||
-		 ( pDiscInputFile != NULL && pDiscOutputFile != NULL && strcmp( pDiscInputFile, pDiscOutputFile ) == 0 ) )
+	if ( options.m_bWatch && options.m_pBatchFile != NULL )
 	{
-		cerr << "If a disc image file is provided as input, a different filename must be provided as output" << endl;
-		return EXIT_FAILURE;
+		errors << "-watch cannot be used with -batch" << endl;
+		return false;
 	}
 
+	if ( ( options.m_pDiscInputFile != NULL && options.m_pDiscOutputFile == NULL ) ||
+		 ( options.m_pDiscInputFile != NULL && options.m_pDiscOutputFile != NULL && strcmp( options.m_pDiscInputFile, options.m_pDiscOutputFile ) == 0 ) )
+	{
+		errors << "If a disc image file is provided as input, a different filename must be provided as output" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	MakeFilename()
+
+	Escapes a filename for a makefile rule
+
+	@param		filename		The filename
+	@returns	string			The filename as make would read it
+*/
+/*************************************************************************************************/
+static string MakeFilename( const string& filename )
+{
+	string escaped;
+
+	for ( size_t i = 0; i < filename.length(); i++ )
+	{
+		char c = filename[ i ];
+
+		if ( c == ' ' || c == '#' )
+		{
+			escaped += '\\';
+		}
+		else if ( c == '$' )
+		{
+			escaped += '$';
+		}
+
+		escaped += c;
+	}
+
+	return escaped;
+}
 
-	// All good, start the assembling
 
-	int exitCode = EXIT_SUCCESS;
 
-	ObjectCode::Create();
-	MacroTable::Create();
+/*************************************************************************************************/
+/**
+	ListFilesWritten()
+
+	Lists the files written by an assembly: those written by SAVE, the disc image, and the labels
+
+	@param		context			The assembly
+	@param		options			The options which aren't held in the context
+	@returns	vector<string>	The filenames
+*/
+/*************************************************************************************************/
+static vector< string > ListFilesWritten( AssemblyContext& context, const Options& options )
+{
+	vector< string > filesWritten( context.GetFilesWritten() );
+
+	if ( options.m_pDiscOutputFile != NULL )
+	{
+		filesWritten.push_back( options.m_pDiscOutputFile );
+	}
+
+	if ( options.m_pLabelsOutputFile != NULL && ( options.m_bDumpSymbols || options.m_bDumpAllSymbols ) )
+	{
+		filesWritten.push_back( options.m_pLabelsOutputFile );
+	}
+
+	return filesWritten;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	WriteDepFile()
+
+	Writes a makefile rule, in the style of a compiler's -MD -MP output, whose targets are the
+	files written by an assembly and whose prerequisites are the files it read.  Each
+	prerequisite also gets an empty rule of its own, so that make doesn't fail if it's deleted.
+
+	@param		options			The options of the assembly
+	@param		filesWritten	The files written by the assembly
+	@param		filesRead		The files read by the assembly
+
+	If there is a problem, an AsmException will be thrown.
+*/
+/*************************************************************************************************/
+static void WriteDepFile( const Options& options, const vector< string >& filesWritten, const AssemblyContext::FilesRead& filesRead )
+{
+	vector< string > targets( filesWritten );
+
+	if ( targets.empty() )
+	{
+		targets.push_back( options.m_pDepFile );
+	}
+
+	// The source file comes first, then the disc image template, then everything else read
+
+	vector< string > prerequisites;
+	prerequisites.push_back( options.m_pInputFile );
+
+	if ( options.m_pDiscInputFile != NULL )
+	{
+		prerequisites.push_back( options.m_pDiscInputFile );
+	}
+
+	for ( AssemblyContext::FilesRead::const_iterator it = filesRead.begin(); it != filesRead.end(); ++it )
+	{
+		if ( it->second.m_contents &&
+			 find( prerequisites.begin(), prerequisites.end(), it->first ) == prerequisites.end() )
+		{
+			prerequisites.push_back( it->first );
+		}
+	}
+
+	ostringstream depFile;
+
+	for ( vector< string >::const_iterator it = targets.begin(); it != targets.end(); ++it )
+	{
+		depFile << ( it == targets.begin() ? "" : " " ) << MakeFilename( *it );
+	}
+
+	depFile << ":";
+
+	for ( vector< string >::const_iterator it = prerequisites.begin(); it != prerequisites.end(); ++it )
+	{
+		depFile << " \\" << endl << "  " << MakeFilename( *it );
+	}
+
+	depFile << endl;
+
+	for ( vector< string >::const_iterator it = prerequisites.begin() + 1; it != prerequisites.end(); ++it )
+	{
+		depFile << endl << MakeFilename( *it ) << ":" << endl;
+	}
+
+	switch ( OutputFile::WriteIfChanged( options.m_pDepFile, depFile.str() ) )
+	{
+		case OutputFile::OPEN_FAILED:
+			throw AsmException_FileError_OpenDepFile( options.m_pDepFile );
+
+		case OutputFile::WRITE_FAILED:
+			throw AsmException_FileError_WriteDepFile( options.m_pDepFile );
+
+		default:
+			break;
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssembleWithoutCache()
+
+	Assembles a source file in both passes, and writes the outputs asked for
+
+	@param		context			The assembly, already set up with its command line options
+	@param		options			The options which aren't held in the context
+	@returns	int				Exit code
+*/
+/*************************************************************************************************/
+static int AssembleWithoutCache( AssemblyContext& context, const Options& options )
+{
+	int exitCode = EXIT_SUCCESS;
 
 	time_t randomSeed = time( NULL );
 
 	DiscImage* pDiscIm = NULL;
 
+	// The files read are noted for the dependency file, unless they're already being noted
+	AssemblyContext::FilesRead filesRead;
+	bool notingFilesRead = ( options.m_pDepFile != NULL && context.GetFilesRead() == NULL );
+
+	if ( notingFilesRead )
+	{
+		context.SetFilesRead( &filesRead );
+	}
+
+	if ( context.GetFilesRead() != NULL && options.m_pDiscInputFile != NULL )
+	{
+		// DiscImage reads the disc image template straight from the file cache, so note it here
+		context.GetFile( options.m_pDiscInputFile );
+	}
+
 	try
 	{
-		if ( GlobalData::Instance().UsesDiscImage() )
+		if ( context.GetGlobalData().UsesDiscImage() )
 		{
-			pDiscIm = new DiscImage( pDiscOutputFile, pDiscInputFile );
-			GlobalData::Instance().SetDiscImage( pDiscIm );
+			pDiscIm = new DiscImage( context.GetGlobalData(), options.m_pDiscOutputFile, options.m_pDiscInputFile );
+			context.GetGlobalData().SetDiscImage( pDiscIm );
 		}
 
-		for ( int pass = 0; pass < 2; pass++ )
+		context.Assemble( options.m_pInputFile, static_cast< unsigned long >( randomSeed ) );
+
+		if ( pDiscIm != NULL )
 		{
-			GlobalData::Instance().SetPass( pass );
-			ObjectCode::Instance().InitialisePass();
-			GlobalData::Instance().ResetForId();
-			beebasm_srand( static_cast< unsigned long >( randomSeed ) );
-			SourceFile input( pInputFile, 0 );
-			input.Process();
+			pDiscIm->Write();
 		}
 	}
 	catch ( AsmException& e )
 	{
-		e.Print();
+		e.Print( context.GetErrors(), context.GetGlobalData().UseVisualCppErrorFormat() );
 		exitCode = EXIT_FAILURE;
 	}
 
 	delete pDiscIm;
+	context.GetGlobalData().SetDiscImage( NULL );
 
-	if ( (bDumpSymbols || bDumpAllSymbols) && exitCode == EXIT_SUCCESS )
+	if ( (options.m_bDumpSymbols || options.m_bDumpAllSymbols) && exitCode == EXIT_SUCCESS )
 	{
-		SymbolTable::Instance().Dump(bDumpSymbols, bDumpAllSymbols, pLabelsOutputFile);
+		context.GetSymbolTable().Dump(options.m_bDumpSymbols, options.m_bDumpAllSymbols, options.m_pLabelsOutputFile);
 	}
 
-	if ( !GlobalData::Instance().IsSaved() && ObjectCode::Instance().AnyUsed() && exitCode == EXIT_SUCCESS )
+	if ( options.m_pDepFile != NULL && exitCode == EXIT_SUCCESS )
 	{
-		cerr << "warning: no SAVE command in source file." << endl;
+		try
+		{
+			WriteDepFile( options, ListFilesWritten( context, options ), *context.GetFilesRead() );
+		}
+		catch ( AsmException& e )
+		{
+			e.Print( context.GetErrors(), context.GetGlobalData().UseVisualCppErrorFormat() );
+			exitCode = EXIT_FAILURE;
+		}
+	}
+
+	if ( notingFilesRead )
+	{
+		context.SetFilesRead( NULL );
+	}
+
+	if ( !context.GetGlobalData().IsSaved() && context.GetObjectCode().AnyUsed() && exitCode == EXIT_SUCCESS )
+	{
+		context.GetErrors() << "warning: no SAVE command in source file." << endl;
+	}
+
+	return exitCode;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	AssembleWithCache()
+
+	Restores the outputs of an identical earlier assembly from the build cache if there is one,
+	or else assembles, and remembers the outputs in the cache.  Assemblies which depend on the
+	time, or on random numbers seeded from it, aren't remembered.
+
+	@param		context			The assembly, already set up with its command line options
+	@param		options			The options which aren't held in the context
+	@returns	int				Exit code
+*/
+/*************************************************************************************************/
+static int AssembleWithCache( AssemblyContext& context, const Options& options )
+{
+	BuildCache cache( options.m_pCacheDirectory );
+
+	AssemblyContext::FilesRead filesRead;
+	vector< string > filesWritten;
+	string cachedOutput;
+	string cachedErrors;
+
+	if ( cache.Restore( options.m_commandKey, filesRead, filesWritten, cachedOutput, cachedErrors ) )
+	{
+		context.GetOutput() << cachedOutput << flush;
+		context.GetErrors() << cachedErrors << flush;
+
+		if ( context.GetFilesRead() != NULL )
+		{
+			*context.GetFilesRead() = filesRead;
+		}
+
+		if ( options.m_pDepFile != NULL )
+		{
+			try
+			{
+				WriteDepFile( options, filesWritten, filesRead );
+			}
+			catch ( AsmException& e )
+			{
+				e.Print( context.GetErrors(), context.GetGlobalData().UseVisualCppErrorFormat() );
+				return EXIT_FAILURE;
+			}
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	// The output is kept, to be remembered along with the files written
+
+	ostream& output = context.GetOutput();
+	ostream& errors = context.GetErrors();
+	ostringstream capturedOutput;
+	ostringstream capturedErrors;
+
+	bool notingFilesRead = ( context.GetFilesRead() == NULL );
+
+	if ( notingFilesRead )
+	{
+		context.SetFilesRead( &filesRead );
+	}
+
+	context.SetOutput( capturedOutput, capturedErrors );
+	int exitCode = AssembleWithoutCache( context, options );
+	context.SetOutput( output, errors );
+
+	output << capturedOutput.str() << flush;
+	errors << capturedErrors.str() << flush;
+
+	if ( exitCode == EXIT_SUCCESS && context.IsRepeatable() &&
+		 !cache.Store( options.m_commandKey,
+					   *context.GetFilesRead(),
+					   ListFilesWritten( context, options ),
+					   capturedOutput.str(),
+					   capturedErrors.str() ) )
+	{
+		errors << "warning: could not write to build cache '" << options.m_pCacheDirectory << "'." << endl;
+	}
+
+	if ( notingFilesRead )
+	{
+		context.SetFilesRead( NULL );
+	}
+
+	return exitCode;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	Assemble()
+
+	Assembles a source file in both passes, and writes the outputs asked for, or restores them
+	from the build cache
+
+	@param		context			The assembly, already set up with its command line options
+	@param		options			The options which aren't held in the context
+	@returns	int				Exit code
+*/
+/*************************************************************************************************/
+static int Assemble( AssemblyContext& context, const Options& options )
+{
+	if ( options.m_pCacheDirectory != NULL )
+	{
+		return AssembleWithCache( context, options );
+	}
+
+	return AssembleWithoutCache( context, options );
+}
+
+
+
+/*************************************************************************************************/
+/**
+	ReadBatchManifest()
+
+	Reads the jobs of a batch from its manifest.  Each line which isn't blank or a comment
+	(starting with #) holds the command line parameters of one assembly, which follow those
+	given on the command line.  A parameter containing spaces may be enclosed in double quotes.
+
+	@param		pFilename					Filename of the manifest
+	@param		batch						Receives the jobs
+	@param		useVisualCppErrorFormat		How to report the location of a syntax error
+	@returns	bool						false if the manifest couldn't be read
+*/
+/*************************************************************************************************/
+static bool ReadBatchManifest( const char* pFilename, Batch& batch, bool useVisualCppErrorFormat )
+{
+	ifstream manifest( pFilename );
+
+	if ( !manifest )
+	{
+		cerr << "Error: " << pFilename << ": Could not open batch manifest for reading." << endl;
+		return false;
+	}
+
+	string line;
+	int lineNumber = 0;
+
+	while ( getline( manifest, line ) )
+	{
+		lineNumber++;
+
+		unique_ptr< BatchJob > job( new BatchJob( lineNumber ) );
+		size_t i = 0;
+
+		while ( i < line.length() )
+		{
+			if ( line[ i ] == ' ' || line[ i ] == '\t' || line[ i ] == '\r' )
+			{
+				i++;
+				continue;
+			}
+
+			if ( line[ i ] == '#' && job->m_args.empty() )
+			{
+				break;
+			}
+
+			string arg;
+
+			if ( line[ i ] == '"' )
+			{
+				size_t end = line.find( '"', i + 1 );
+
+				if ( end == string::npos )
+				{
+					cerr << StringUtils::FormattedErrorLocation( pFilename, lineNumber, useVisualCppErrorFormat )
+						 << ": error: Unterminated string." << endl;
+					return false;
+				}
+
+				arg = line.substr( i + 1, end - i - 1 );
+				i = end + 1;
+			}
+			else
+			{
+				size_t end = line.find_first_of( " \t\r", i );
+
+				if ( end == string::npos )
+				{
+					end = line.length();
+				}
+
+				arg = line.substr( i, end - i );
+				i = end;
+			}
+
+			job->m_args.push_back( arg );
+		}
+
+		if ( !job->m_args.empty() )
+		{
+			batch.m_jobs.push_back( move( job ) );
+		}
+	}
+
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	RunBatchJobs()
+
+	Runs the jobs of a batch on one thread, taking the next job nobody has started until there
+	are none left.  Each job has its own AssemblyContext, with its output kept apart so that it
+	can be written out in manifest order.
+
+	@param		batch			The batch
+*/
+/*************************************************************************************************/
+static void RunBatchJobs( Batch& batch )
+{
+	for (;;)
+	{
+		size_t index = batch.m_nextJob++;
+
+		if ( index >= batch.m_jobs.size() )
+		{
+			return;
+		}
+
+		BatchJob& job = *batch.m_jobs[ index ];
+
+		vector< const char* > args( batch.m_commonArgs );
+
+		for ( vector< string >::const_iterator it = job.m_args.begin(); it != job.m_args.end(); ++it )
+		{
+			args.push_back( it->c_str() );
+		}
+
+		AssemblyContext context;
+		context.SetOutput( job.m_output, job.m_errors );
+
+		Options options;
+		int exitCode;
+
+		if ( ParseOptions( static_cast< int >( args.size() ), args.data(), context, options, NULL, exitCode ) )
+		{
+			exitCode = Assemble( context, options );
+		}
+
+		lock_guard< mutex > lock( batch.m_mutex );
+		job.m_exitCode = exitCode;
+		job.m_bDone = true;
+		batch.m_jobDone.notify_all();
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	RunBatch()
+
+	Runs the assemblies listed in a manifest at the same time, writing out the output of each
+	in turn as it finishes
+
+	@param		options			The command line options
+	@param		commonArgs		The command line parameters to pass to every job
+	@param		useVisualCppErrorFormat		How to report the location of a failed job
+	@returns	int				Exit code; failure if any job failed
+*/
+/*************************************************************************************************/
+static int RunBatch( const Options& options, const vector< const char* >& commonArgs, bool useVisualCppErrorFormat )
+{
+	Batch batch;
+	batch.m_commonArgs = commonArgs;
+
+	if ( !ReadBatchManifest( options.m_pBatchFile, batch, useVisualCppErrorFormat ) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	size_t numThreads = options.m_numBatchThreads;
+
+	if ( numThreads == 0 )
+	{
+		numThreads = max( thread::hardware_concurrency(), 1u );
+	}
+
+	numThreads = min( numThreads, batch.m_jobs.size() );
+
+	vector< thread > threads;
+
+	for ( size_t i = 0; i < numThreads; i++ )
+	{
+		threads.push_back( thread( RunBatchJobs, ref( batch ) ) );
+	}
+
+	int exitCode = EXIT_SUCCESS;
+
+	for ( size_t i = 0; i < batch.m_jobs.size(); i++ )
+	{
+		BatchJob& job = *batch.m_jobs[ i ];
+
+		{
+			unique_lock< mutex > lock( batch.m_mutex );
+
+			while ( !job.m_bDone )
+			{
+				batch.m_jobDone.wait( lock );
+			}
+		}
+
+		cout << job.m_output.str() << flush;
+		cerr << job.m_errors.str();
+
+		if ( job.m_exitCode != EXIT_SUCCESS )
+		{
+			cerr << StringUtils::FormattedErrorLocation( options.m_pBatchFile, job.m_lineNumber, useVisualCppErrorFormat )
+				 << ": error: Batch job failed." << endl;
+			exitCode = EXIT_FAILURE;
+		}
+	}
+
+	for ( vector< thread >::iterator it = threads.begin(); it != threads.end(); ++it )
+	{
+		it->join();
+	}
+
+	return exitCode;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	WaitForChanges()
+
+	Waits until any of the files read by an assembly has changed since it was read, polling the
+	file cache, which reads a file again when its size or modification time changes
+
+	@param		filesRead		The files read, and what was read from them
+	@returns	string			The name of a file which has changed
+*/
+/*************************************************************************************************/
+static string WaitForChanges( const AssemblyContext::FilesRead& filesRead )
+{
+	for (;;)
+	{
+		this_thread::sleep_for( chrono::milliseconds( WATCH_POLL_INTERVAL_MS ) );
+
+		for ( AssemblyContext::FilesRead::const_iterator it = filesRead.begin(); it != filesRead.end(); ++it )
+		{
+			const FileContents& was = it->second.m_contents;
+			FileContents now = it->second.m_isSource ? FileCache::Instance().GetSourceText( it->first )
+													 : FileCache::Instance().GetFile( it->first );
+
+			if ( now != was && ( !now || !was || *now != *was ) )
+			{
+				return it->first;
+			}
+		}
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	Watch()
+
+	Assembles, and then assembles again every time one of the files read changes, until the
+	program is interrupted.  Each assembly starts afresh from the command line parameters, but
+	files which haven't changed aren't read again, and their lines aren't lexed again.
+
+	@param		argc			Number of command line parameters
+	@param		argv			Array of command line parameters
+	@returns	int				Exit code, if the parameters can't be parsed
+*/
+/*************************************************************************************************/
+static int Watch( int argc, const char* const argv[] )
+{
+	unique_ptr< AssemblyContext > previous;
+
+	for (;;)
+	{
+		unique_ptr< AssemblyContext > context( new AssemblyContext );
+		Options options;
+		vector< const char* > commonArgs;
+		int exitCode;
+
+		if ( !ParseOptions( argc, argv, *context, options, &commonArgs, exitCode ) )
+		{
+			return exitCode;
+		}
+
+		if ( previous )
+		{
+			context->TakeLineCaches( *previous );
+		}
+
+		AssemblyContext::FilesRead filesRead;
+		context->SetFilesRead( &filesRead );
+		Assemble( *context, options );
+		context->SetFilesRead( NULL );
+
+		cerr << "Watching " << filesRead.size() << " file(s) for changes; press Ctrl-C to stop" << endl;
+
+		string changed = WaitForChanges( filesRead );
+
+		cerr << "File '" << changed << "' changed, assembling again" << endl;
+
+		previous = move( context );
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	main()
+
+	The main entry point for the application
+
+	@param		argc			Number of parameters passed
+	@param		argv			Array of parameters
+*/
+/*************************************************************************************************/
+
+int main( int argc, char* argv[] )
+{
+	SymbolNamePool::Create();
+
+	unique_ptr< AssemblyContext > context( new AssemblyContext );
+	Options options;
+	vector< const char* > commonArgs;
+	int exitCode;
+
+	// Parse command line parameters
+
+	if ( ParseOptions( argc - 1, argv + 1, *context, options, &commonArgs, exitCode ) )
+	{
+		// All good, start the assembling
+
+		FileCache::Create();
+
+		if ( options.m_pBatchFile != NULL )
+		{
+			// Each job in the batch parses the command line parameters again into its own context
+			bool useVisualCppErrorFormat = context->GetGlobalData().UseVisualCppErrorFormat();
+			context.reset();
+			exitCode = RunBatch( options, commonArgs, useVisualCppErrorFormat );
+		}
+		else if ( options.m_bWatch )
+		{
+			context.reset();
+			exitCode = Watch( argc - 1, argv + 1 );
+		}
+		else
+		{
+			exitCode = Assemble( *context, options );
+		}
+
+		context.reset();
+		FileCache::Destroy();
 	}
 
-	MacroTable::Destroy();
-	ObjectCode::Destroy();
-	SymbolTable::Destroy();
-	GlobalData::Destroy();
+	context.reset();
+	SymbolNamePool::Destroy();
 
 	return exitCode;
 }
@@ -20,51 +20,32 @@
 */
 /*************************************************************************************************/
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <fstream>
 
 #include "objectcode.h"
+#include "assemblycontext.h"
+#include "filecache.h"
 #include "symboltable.h"
 #include "asmexception.h"
 #include "globaldata.h"
 
 
-ObjectCode* ObjectCode::m_gInstance = NULL;
-
-
 using namespace std;
 
 
 /*************************************************************************************************/
 /**
-	ObjectCode::Create()
-
-	Creates the ObjectCode singleton
-*/
-/*************************************************************************************************/
-void ObjectCode::Create()
-{
-	assert( m_gInstance == NULL );
-
-	m_gInstance = new ObjectCode;
-}
-
-
-
-/*************************************************************************************************/
-/**
-	ObjectCode::Destroy()
+	ObjectCode::GetCPUValue()
 
-	Destroys the ObjectCode singleton
+	Computes the value of the CPU symbol
 */
 /*************************************************************************************************/
-void ObjectCode::Destroy()
+Value ObjectCode::GetCPUValue( AssemblyContext& context )
 {
-	assert( m_gInstance != NULL );
-
-	delete m_gInstance;
-	m_gInstance = NULL;
+	return static_cast< double >( context.GetObjectCode().GetCPU() );
 }
 
 
@@ -74,15 +55,18 @@ void ObjectCode::Destroy()
 	ObjectCode::ObjectCode()
 
 	ObjectCode constructor
+
+	@param		context			The assembly this object code belongs to
 */
 /*************************************************************************************************/
-ObjectCode::ObjectCode()
-	:	m_PC( 0 ),
+ObjectCode::ObjectCode( AssemblyContext& context )
+	:	m_context( context ),
+		m_PC( 0 ),
 		m_CPU( CPU_6502 )
 {
 	memset( m_aMemory, 0, sizeof m_aMemory );
 	memset( m_aFlags, 0, sizeof m_aFlags );
-	SymbolTable::Instance().AddBuiltInSymbol( "CPU", m_CPU );
+	m_context.GetSymbolTable().AddComputedBuiltInSymbol( "CPU", &GetCPUValue );
 }
 
 
@@ -110,7 +94,6 @@ ObjectCode::~ObjectCode()
 void ObjectCode::SetCPU( CPU_TYPE cpu )
 {
 	m_CPU = cpu;
-	SymbolTable::Instance().ChangeBuiltInSymbol( "CPU", m_CPU );
 }
 
 
@@ -128,7 +111,6 @@ void ObjectCode::InitialisePass()
 
 	SetCPU( CPU_6502 );
 	SetPC( 0 );
-	SymbolTable::Instance().ChangeBuiltInSymbol( "P%", m_PC );
 
 	// Clear flags between passes
 
@@ -173,7 +155,6 @@ void ObjectCode::PutByte( unsigned int byte )
 	m_aFlags[ m_PC ] |= USED;
 	m_aMemory[ m_PC++ ] = byte;
 
-	SymbolTable::Instance().ChangeBuiltInSymbol( "P%", m_PC );
 }
 
 
@@ -195,7 +176,7 @@ void ObjectCode::Assemble1( unsigned int opcode )
 	assert( m_PC >= 0 && m_PC < 0x10000 );
 	assert( opcode < 0x100 );
 
-	if ( GlobalData::Instance().IsSecondPass() &&
+	if ( m_context.GetGlobalData().IsSecondPass() &&
 		 ( m_aFlags[ m_PC ] & CHECK ) &&
 		 !( m_aFlags[ m_PC ] & DONT_CHECK ) &&
 		 m_aMemory[ m_PC ] != opcode )
@@ -216,7 +197,6 @@ void ObjectCode::Assemble1( unsigned int opcode )
 	m_aFlags[ m_PC ] |= ( USED | CHECK );
 	m_aMemory[ m_PC++ ] = opcode;
 
-	SymbolTable::Instance().ChangeBuiltInSymbol( "P%", m_PC );
 }
 
 
@@ -239,7 +219,7 @@ void ObjectCode::Assemble2( unsigned int opcode, unsigned int val )
 	assert( opcode < 0x100 );
 	assert( val < 0x100 );
 
-	if ( GlobalData::Instance().IsSecondPass() &&
+	if ( m_context.GetGlobalData().IsSecondPass() &&
 		 ( m_aFlags[ m_PC ] & CHECK ) &&
 		 !( m_aFlags[ m_PC ] & DONT_CHECK ) &&
 		 m_aMemory[ m_PC ] != opcode )
@@ -264,7 +244,6 @@ void ObjectCode::Assemble2( unsigned int opcode, unsigned int val )
 	m_aFlags[ m_PC ] |= USED;
 	m_aMemory[ m_PC++ ] = val;
 
-	SymbolTable::Instance().ChangeBuiltInSymbol( "P%", m_PC );
 }
 
 
@@ -287,7 +266,7 @@ void ObjectCode::Assemble3( unsigned int opcode, unsigned int addr )
 	assert( opcode < 0x100 );
 	assert( addr < 0x10000 );
 
-	if ( GlobalData::Instance().IsSecondPass() &&
+	if ( m_context.GetGlobalData().IsSecondPass() &&
 		 ( m_aFlags[ m_PC ] & CHECK ) &&
 		 !( m_aFlags[ m_PC ] & DONT_CHECK ) &&
 		 m_aMemory[ m_PC ] != opcode )
@@ -316,7 +295,6 @@ void ObjectCode::Assemble3( unsigned int opcode, unsigned int addr )
 	m_aFlags[ m_PC ] |= USED;
 	m_aMemory[ m_PC++ ] = ( addr & 0xFF00 ) >> 8;
 
-	SymbolTable::Instance().ChangeBuiltInSymbol( "P%", m_PC );
 }
 
 
@@ -380,34 +358,69 @@ void ObjectCode::Clear( int start, int end, bool bAll )
 /*************************************************************************************************/
 void ObjectCode::IncBin( const char* filename, std::vector<unsigned char>& firstFour )
 {
-	ifstream binfile;
-
-	binfile.open( filename, ios_base::in | ios_base::binary );
+	FileContents contents = m_context.GetFile( filename );
 
-	if ( !binfile )
+	if ( !contents )
 	{
 		throw AsmException_AssembleError_FileOpen();
 	}
 
-	char c;
+	const unsigned char* data = reinterpret_cast< const unsigned char* >( contents->data() );
+	size_t length = contents->length();
 
-	while ( binfile.get( c ) )
+	firstFour.assign( data, data + min< size_t >( length, 4 ) );
+
+	// Find how many bytes can be assembled before one would fail; usually that's all of them,
+	// which we can tell just by checking that none of the destination has been touched yet
+
+	size_t room = ( m_PC < 0x10000 ) ? static_cast< size_t >( 0x10000 - m_PC ) : 0;
+	size_t count = min( length, room );
+	unsigned char* pFlags = m_aFlags + m_PC;
+
+	unsigned char allFlags = 0;
+	for ( size_t i = 0; i < count; i++ )
+	{
+		allFlags |= pFlags[ i ];
+	}
+
+	if ( allFlags & ( USED | GUARD | CHECK ) )
 	{
-		assert( binfile.gcount() == 1 );
-		unsigned char uc = static_cast< unsigned char >( c );
-		if ( firstFour.size() < 4 )
+		bool secondPass = m_context.GetGlobalData().IsSecondPass();
+		const unsigned char* pMemory = m_aMemory + m_PC;
+
+		for ( size_t i = 0; i < count; i++ )
 		{
-			firstFour.push_back(uc);
+			if ( ( pFlags[ i ] & ( USED | GUARD ) ) ||
+				 ( secondPass &&
+				   ( pFlags[ i ] & CHECK ) &&
+				   !( pFlags[ i ] & DONT_CHECK ) &&
+				   pMemory[ i ] != data[ i ] ) )
+			{
+				count = i;
+				break;
+			}
 		}
-		Assemble1( uc );
 	}
 
-	if ( !binfile.eof() )
+	if ( count > 0 )
 	{
-		throw AsmException_AssembleError_FileRead();
+		memcpy( m_aMemory + m_PC, data, count );
+
+		for ( size_t i = 0; i < count; i++ )
+		{
+			pFlags[ i ] |= ( USED | CHECK );
+		}
+
+		m_PC += static_cast< int >( count );
 	}
 
-	binfile.close();
+	// Assembling the byte which can't be assembled raises the appropriate error
+
+	if ( count < length )
+	{
+		Assemble1( data[ count ] );
+		assert( false );
+	}
 }
 
 
@@ -27,6 +27,8 @@
 #include <cstdlib>
 #include <vector>
 
+#include "value.h"
+
 
 
 enum CPU_TYPE
@@ -35,19 +37,21 @@ enum CPU_TYPE
 	CPU_65C02
 };
 
+class AssemblyContext;
+
 class ObjectCode
 {
 public:
 
-	static void Create();
-	static void Destroy();
-	static inline ObjectCode& Instance() { assert( m_gInstance != NULL ); return *m_gInstance; }
+	explicit ObjectCode( AssemblyContext& context );
+	~ObjectCode();
 
 	inline void SetPC( int i )		{ m_PC = i; }
 	inline int GetPC() const		{ return m_PC; }
 
 	void SetCPU( CPU_TYPE cpu );
 	inline CPU_TYPE GetCPU() const		{ return m_CPU; }
+	static Value GetCPUValue( AssemblyContext& context );
 
 	inline const unsigned char* GetAddr( int i ) const { return m_aMemory + i; }
 
@@ -84,9 +88,7 @@ private:
 		DONT_CHECK = (1 << 3)
 	};
 
-
-	ObjectCode();
-	~ObjectCode();
+	AssemblyContext&			m_context;
 
 	unsigned char				m_aMemory[ 0x10000 ];
 	unsigned char				m_aFlags[ 0x10000 ];
@@ -94,8 +96,6 @@ private:
 	CPU_TYPE					m_CPU;
 
 	unsigned char				m_aMapChar[ 96 ];
-
-	static ObjectCode*			m_gInstance;
 };
 
 
@@ -0,0 +1,120 @@
+/*************************************************************************************************/
+/**
+	outputfile.cpp
+
+	Writes output files, leaving alone those which haven't changed
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "outputfile.h"
+
+
+using namespace std;
+
+
+// How much of an existing file is compared at a time
+static const size_t COMPARE_CHUNK_SIZE = 0x10000;
+
+
+
+/*************************************************************************************************/
+/**
+	SameContents()
+
+	Whether a file already exists holding exactly the given contents.  The length is checked
+	before anything is read, so a file which has changed size costs nothing to compare.
+
+	@param		filename		The file
+	@param		pData			The contents to compare it with
+	@param		length			Their length in bytes
+	@returns	bool
+*/
+/*************************************************************************************************/
+static bool SameContents( const string& filename, const char* pData, size_t length )
+{
+	ifstream file( filename.c_str(), ios_base::in | ios_base::binary );
+
+	if ( !file || !file.seekg( 0, ios_base::end ) )
+	{
+		return false;
+	}
+
+	streampos fileLength = file.tellg();
+
+	if ( fileLength < 0 || static_cast< size_t >( fileLength ) != length || !file.seekg( 0, ios_base::beg ) )
+	{
+		return false;
+	}
+
+	// On the heap, as this may run on a batch thread with a small stack
+	vector< char > chunk( min( COMPARE_CHUNK_SIZE, length ) );
+
+	for ( size_t offset = 0; offset < length; offset += COMPARE_CHUNK_SIZE )
+	{
+		size_t chunkLength = min( COMPARE_CHUNK_SIZE, length - offset );
+
+		if ( !file.read( &chunk[ 0 ], chunkLength ) || memcmp( &chunk[ 0 ], pData + offset, chunkLength ) != 0 )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	OutputFile::WriteIfChanged()
+
+	Writes a file, unless it already holds exactly these contents, in which case it's left alone
+
+	@param		filename		The file
+	@param		pData			Its contents
+	@param		length			Their length in bytes
+	@returns	Result			Whether it was written, or why it couldn't be
+*/
+/*************************************************************************************************/
+OutputFile::Result OutputFile::WriteIfChanged( const string& filename, const char* pData, size_t length )
+{
+	if ( SameContents( filename, pData, length ) )
+	{
+		return UNCHANGED;
+	}
+
+	ofstream file( filename.c_str(), ios_base::out | ios_base::binary | ios_base::trunc );
+
+	if ( !file )
+	{
+		return OPEN_FAILED;
+	}
+
+	if ( !file.write( pData, length ) || !file.flush() )
+	{
+		return WRITE_FAILED;
+	}
+
+	return WRITTEN;
+}
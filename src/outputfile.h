@@ -0,0 +1,52 @@
+/*************************************************************************************************/
+/**
+	outputfile.h
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#ifndef OUTPUTFILE_H_
+#define OUTPUTFILE_H_
+
+#include <cstddef>
+#include <string>
+
+
+// Every file BeebAsm writes is built in memory first, and is only written out if it doesn't
+// already hold exactly those contents.  An unchanged output keeps its modification time, so
+// whatever is built from it downstream isn't rebuilt.
+namespace OutputFile
+{
+	enum Result
+	{
+		UNCHANGED,
+		WRITTEN,
+		OPEN_FAILED,
+		WRITE_FAILED
+	};
+
+	Result WriteIfChanged( const std::string& filename, const char* pData, size_t length );
+
+	inline Result WriteIfChanged( const std::string& filename, const std::string& contents )
+	{
+		return WriteIfChanged( filename, contents.data(), contents.length() );
+	}
+}
+
+
+#endif // OUTPUTFILE_H_
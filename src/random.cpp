@@ -26,16 +26,20 @@
 
 #include "random.h"
 
-static uint_least32_t state = 19670512;
+static const uint_least32_t modulus = BEEBASM_RAND_MODULUS;
 
-static uint_least32_t modulus = BEEBASM_RAND_MODULUS;
+RandomGenerator::RandomGenerator()
+        : m_state(19670512), m_repeatable(true)
+{
+}
 
-void beebasm_srand(uint_least32_t seed)
+void RandomGenerator::Seed(uint_least32_t seed, bool repeatable)
 {
-        state = seed % modulus;
-        if ( state == 0 )
+        m_repeatable = repeatable;
+        m_state = seed % modulus;
+        if ( m_state == 0 )
         {
-                state = 1;
+                m_state = 1;
         }
 
         // Generate and discard a few random numbers to avoid small changes to
@@ -43,15 +47,15 @@ void beebasm_srand(uint_least32_t seed)
         // generated.
         for ( int i = 0; i < 5; ++i )
         {
-            (void) beebasm_rand();
+            (void) Next();
         }
 }
 
-uint_least32_t beebasm_rand()
+uint_least32_t RandomGenerator::Next()
 {
-        state = ( static_cast<uint_least64_t>(BEEBASM_RAND_MULTIPLIER) * state ) % modulus;
+        m_state = ( static_cast<uint_least64_t>(BEEBASM_RAND_MULTIPLIER) * m_state ) % modulus;
         // It's always true that 1 <= state <= (modulus - 1), so we return state - 1 to make
         // 0 a possible value. BEEBASM_RAND_MAX is modulus - 2, so we have 0 <= return value <=
         // BEEBASM_RAND_MAX as required for compatibility with the interface of rand().
-        return state - 1;
+        return m_state - 1;
 }
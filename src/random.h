@@ -30,8 +30,25 @@
 #define BEEBASM_RAND_MODULUS static_cast<uint_least32_t>(2147483647)
 #define BEEBASM_RAND_MAX (BEEBASM_RAND_MODULUS - static_cast<uint_least32_t>(2))
 
-void beebasm_srand(uint_least32_t seed);
+// The state of RANDOMIZE and RND(), which belongs to a single assembly
+class RandomGenerator
+{
+public:
 
-uint_least32_t beebasm_rand();
+        RandomGenerator();
+
+        // A seed which isn't repeatable, such as the time, makes the numbers generated differ
+        // between assemblies
+        void Seed(uint_least32_t seed, bool repeatable = true);
+
+        uint_least32_t Next();
+
+        bool IsRepeatable() const { return m_repeatable; }
+
+private:
+
+        uint_least32_t m_state;
+        bool m_repeatable;
+};
 
 #endif // RANDOM_H_
@@ -23,30 +23,51 @@
 #ifndef SCOPEDSYMBOLNAME_H_
 #define SCOPEDSYMBOLNAME_H_
 
-#include <functional>
+#include <cstddef>
 #include <string>
 
+#include "symbolnamepool.h"
 
+
+// A symbol name qualified by the scope it was defined in.  The name is held as its id in the
+// SymbolNamePool, so comparing and hashing never touch the string.
 class ScopedSymbolName
 {
-	friend class std::hash<ScopedSymbolName>;
-
 public:
-	explicit ScopedSymbolName(const std::string& name) : m_name(name), m_id(-1), m_count(-1)
+	explicit ScopedSymbolName(const std::string& name) : m_nameId(SymbolNamePool::Instance().Intern(name)), m_id(-1), m_count(-1)
+	{
+	}
+
+	ScopedSymbolName(const std::string& name, int id, int count) : m_nameId(SymbolNamePool::Instance().Intern(name)), m_id(id), m_count(count)
+	{
+	}
+
+	ScopedSymbolName(int nameId, int id, int count) : m_nameId(nameId), m_id(id), m_count(count)
 	{
 	}
 
-	ScopedSymbolName(const std::string& name, int id, int count) : m_name(name), m_id(id), m_count(count)
+	ScopedSymbolName() : m_nameId(-1), m_id(-1), m_count(-1)
 	{
 	}
 
-	ScopedSymbolName()
+	const std::string& Name() const
 	{
+		return SymbolNamePool::Instance().GetName(m_nameId);
 	}
 
-	std::string Name() const
+	int NameId() const
 	{
-		return m_name;
+		return m_nameId;
+	}
+
+	int ScopeId() const
+	{
+		return m_id;
+	}
+
+	int Count() const
+	{
+		return m_count;
 	}
 
 	bool TopLevel() const
@@ -56,18 +77,20 @@ public:
 
 	bool operator== (const ScopedSymbolName& that) const
 	{
-		return m_name == that.m_name && m_id == that.m_id && m_count == that.m_count;
+		return m_nameId == that.m_nameId && m_id == that.m_id && m_count == that.m_count;
+	}
+
+	bool operator!= (const ScopedSymbolName& that) const
+	{
+		return !(*this == that);
 	}
 
+	// Orders by the text of the name, for listings
 	bool operator< (const ScopedSymbolName& that) const
 	{
-		if (m_name < that.m_name)
-		{
-			return true;
-		}
-		if (m_name > that.m_name)
+		if (m_nameId != that.m_nameId)
 		{
-			return false;
+			return Name() < that.Name();
 		}
 		if (m_id < that.m_id)
 		{
@@ -84,10 +107,18 @@ public:
 		return false;
 	}
 
+	std::size_t Hash() const
+	{
+		std::size_t h = static_cast<std::size_t>(static_cast<unsigned int>(m_nameId) * 0x9E3779B1u);
+		h ^= static_cast<std::size_t>(static_cast<unsigned int>(m_id) * 0x85EBCA6Bu);
+		h ^= static_cast<std::size_t>(static_cast<unsigned int>(m_count) * 0xC2B2AE35u);
+		return h ^ (h >> 15);
+	}
+
 private:
 
-	// The symbol name
-	std::string m_name;
+	// The symbol name, as an id in the SymbolNamePool
+	int m_nameId;
 	// The scope identifier
 	int m_id;
 	// The for loop count (number of times through, not current value)
@@ -96,21 +127,6 @@ private:
 };
 
 
-template<>
-struct std::hash<ScopedSymbolName>
-{
-	std::size_t operator()(const ScopedSymbolName& s) const
-	{
-		std::hash<std::string> hasher;
-		std::size_t h1 = hasher(s.m_name);
-		std::size_t h2 = s.m_id;
-		std::size_t h3 = s.m_count;
-		std::size_t h = h1 ^ (h2 * 3) ^ (h3 * 7);
-		return h;
-	}
-};
-
-
 
 
 #endif // SCOPEDSYMBOLNAME_H_
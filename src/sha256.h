@@ -0,0 +1,55 @@
+/*************************************************************************************************/
+/**
+	sha256.h
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <stdint.h>
+#include <string>
+
+
+// Computes the SHA-256 digest of some data, which can be given a piece at a time
+class Sha256
+{
+public:
+
+	Sha256();
+
+	void Update( const char* data, size_t length );
+	inline void Update( const std::string& text ) { Update( text.data(), text.length() ); }
+
+	// Finishes the digest, after which no more data can be added
+	std::string HexDigest();
+
+private:
+
+	void ProcessBlock( const unsigned char* block );
+
+	uint32_t			m_state[ 8 ];
+	unsigned char		m_buffer[ 64 ];
+	size_t				m_bufferLength;
+	unsigned long long	m_totalLength;
+};
+
+
+
+#endif // SHA256_H_
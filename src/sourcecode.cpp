@@ -23,12 +23,14 @@
 /*************************************************************************************************/
 
 #include "sourcecode.h"
+#include "assemblycontext.h"
 #include "asmexception.h"
 #include "stringutils.h"
 #include "globaldata.h"
 #include "lineparser.h"
 #include "symboltable.h"
 #include "macro.h"
+#include "linecache.h"
 
 using namespace std;
 
@@ -40,31 +42,38 @@ using namespace std;
 
 	Constructor for SourceCode
 
+	@param		context			The assembly the source code is part of
 	@param		filename		Filename of source file to open
 	@param		lineNumber		Line number
+	@param		text			The source text, which is shared rather than copied
+	@param		lineCache		Cache of lexed lines belonging to the source text
 	@param		parent  		Parent SourceCode object (or null)
 
 	The supplied file will be opened.  If there is a problem, an AsmException will be thrown.
 */
 /*************************************************************************************************/
-SourceCode::SourceCode( const string& filename, int lineNumber, const std::string& text, const SourceCode* parent )
-	:	m_forStackPtr( 0 ),
+SourceCode::SourceCode( AssemblyContext& context, const string& filename, int lineNumber, const SourceText& text, LineCache& lineCache, const SourceCode* parent )
+	:	m_context( context ),
 		m_initialForStackPtr( 0 ),
-		m_ifStackPtr( 0 ),
 		m_initialIfStackPtr( 0 ),
+		m_falseIfCount( 0 ),
+		m_ownStacks( ( parent == NULL ) ? new ScopeStacks : NULL ),
+		m_forStack( ( parent == NULL ) ? m_ownStacks->m_forStack : parent->m_forStack ),
+		m_ifStack( ( parent == NULL ) ? m_ownStacks->m_ifStack : parent->m_ifStack ),
 		m_currentMacro( NULL ),
 		m_filename( filename ),
 		m_lineNumber( lineNumber ),
 		m_parent( parent ),
 		m_lineStartPointer( 0 ),
 		m_text( text ),
+		m_lineCache( &lineCache ),
 		m_textPointer( 0 )
 {
 	// Double-check the supplied text came with a '\n' sentinel
-	if (m_text.empty() || m_text.back() != '\n')
+	if (m_text->empty() || m_text->back() != '\n')
 	{
 		assert(false);
-		m_text.push_back('\n');
+		m_text = make_shared<const string>(*m_text + '\n');
 	}
 }
 
@@ -96,28 +105,28 @@ void SourceCode::Process()
 {
 	// Remember the FOR and IF stack initial pointer values
 
-	m_initialForStackPtr = m_forStackPtr;
-	m_initialIfStackPtr = m_ifStackPtr;
+	m_initialForStackPtr = m_forStack.size();
+	m_initialIfStackPtr = m_ifStack.size();
 
 	// Reuse the parser because it's a big object and expensive to construct/destruct
 	LineParser parser( this );
 
 	// Iterate through the file line-by-line
 
-	string lineFromFile;
+	LexedLine* lineFromFile;
 
-	while ( GetLine( lineFromFile ) )
+	while ( ( lineFromFile = GetLine() ) != NULL )
 	{
 //		// Display and process
 //
-//		if ( GlobalData::Instance().IsFirstPass() )
+//		if ( m_context.GetGlobalData().IsFirstPass() )
 //		{
 //			cout << setw( 5 ) << m_lineNumber << ": " << lineFromFile << endl;
 //		}
 
 		try
 		{
-			parser.Process( lineFromFile );
+			parser.Process( *lineFromFile );
 		}
 		catch ( AsmException_SyntaxError& e )
 		{
@@ -140,9 +149,9 @@ void SourceCode::Process()
 
 	// Check that we have no FOR / braces mismatch
 
-	if ( m_forStackPtr != m_initialForStackPtr )
+	if ( static_cast<int>(m_forStack.size()) != m_initialForStackPtr )
 	{
-		For& mismatchedFor = m_forStack[ m_forStackPtr - 1 ];
+		For& mismatchedFor = m_forStack.back();
 
 		if ( mismatchedFor.m_step == 0.0 )
 		{
@@ -162,9 +171,9 @@ void SourceCode::Process()
 
 	// Check that we have no IF / MACRO mismatch
 
-	if ( m_ifStackPtr != m_initialIfStackPtr )
+	if ( static_cast<int>(m_ifStack.size()) != m_initialIfStackPtr )
 	{
-		If& mismatchedIf = m_ifStack[ m_ifStackPtr - 1 ];
+		If& mismatchedIf = m_ifStack.back();
 
 		if ( mismatchedIf.m_isMacroDefinition )
 		{
@@ -198,30 +207,33 @@ void SourceCode::AddFor( const ScopedSymbolName& varName,
 						 const string& line,
 						 int column )
 {
-	if ( m_forStackPtr == MAX_FOR_LEVELS )
+	if ( m_forStack.size() == MAX_FOR_LEVELS )
 	{
 		throw AsmException_SyntaxError_TooManyFORs( line, column );
 	}
 
 	// Add symbol to table
 
-	SymbolTable::Instance().AddSymbol( varName, start );
+	m_context.GetSymbolTable().AddSymbol( varName, start );
 
 	// Fill in FOR block
 
-	m_forStack[ m_forStackPtr ].m_varName		= varName;
-	m_forStack[ m_forStackPtr ].m_current		= start;
-	m_forStack[ m_forStackPtr ].m_end			= end;
-	m_forStack[ m_forStackPtr ].m_step			= step;
-	m_forStack[ m_forStackPtr ].m_filePtr		= filePtr;
-	m_forStack[ m_forStackPtr ].m_id			= GlobalData::Instance().GetNextForId();
-	m_forStack[ m_forStackPtr ].m_count			= 0;
-	m_forStack[ m_forStackPtr ].m_line			= line;
-	m_forStack[ m_forStackPtr ].m_column		= column;
-	m_forStack[ m_forStackPtr ].m_lineNumber	= m_lineNumber;
-
-	SymbolTable::Instance().PushFor(m_forStack[ m_forStackPtr ].m_varName, m_forStack[ m_forStackPtr ].m_current);
-	m_forStackPtr++;
+	m_forStack.push_back( For() );
+	For& newFor = m_forStack.back();
+
+	newFor.m_varName		= varName;
+	newFor.m_current		= start;
+	newFor.m_end			= end;
+	newFor.m_step			= step;
+	newFor.m_filePtr		= filePtr;
+	newFor.m_id				= m_context.GetGlobalData().GetNextForId();
+	newFor.m_count			= 0;
+	newFor.m_line			= line;
+	newFor.m_column			= column;
+	newFor.m_lineNumber		= m_lineNumber;
+
+	m_context.GetSymbolTable().PushFor( newFor.m_varName, newFor.m_current );
+	m_context.GetSymbolTable().EnterScope( newFor.m_id, 0 );
 }
 
 
@@ -235,26 +247,29 @@ void SourceCode::AddFor( const ScopedSymbolName& varName,
 /*************************************************************************************************/
 void SourceCode::OpenBrace( const string& line, int column )
 {
-	if ( m_forStackPtr == MAX_FOR_LEVELS )
+	if ( m_forStack.size() == MAX_FOR_LEVELS )
 	{
 		throw AsmException_SyntaxError_TooManyFORs( line, column );
 	}
 
 	// Fill in FOR block
 
-	m_forStack[ m_forStackPtr ].m_varName		= ScopedSymbolName();
-	m_forStack[ m_forStackPtr ].m_current		= 1.0;
-	m_forStack[ m_forStackPtr ].m_end			= 0.0;
-	m_forStack[ m_forStackPtr ].m_step			= 0.0;
-	m_forStack[ m_forStackPtr ].m_filePtr		= 0;
-	m_forStack[ m_forStackPtr ].m_id			= GlobalData::Instance().GetNextForId();
-	m_forStack[ m_forStackPtr ].m_count			= 0;
-	m_forStack[ m_forStackPtr ].m_line			= line;
-	m_forStack[ m_forStackPtr ].m_column		= column;
-	m_forStack[ m_forStackPtr ].m_lineNumber	= m_lineNumber;
-
-	SymbolTable::Instance().PushBrace();
-	m_forStackPtr++;
+	m_forStack.push_back( For() );
+	For& newFor = m_forStack.back();
+
+	newFor.m_varName		= ScopedSymbolName();
+	newFor.m_current		= 1.0;
+	newFor.m_end			= 0.0;
+	newFor.m_step			= 0.0;
+	newFor.m_filePtr		= 0;
+	newFor.m_id				= m_context.GetGlobalData().GetNextForId();
+	newFor.m_count			= 0;
+	newFor.m_line			= line;
+	newFor.m_column			= column;
+	newFor.m_lineNumber		= m_lineNumber;
+
+	m_context.GetSymbolTable().PushBrace();
+	m_context.GetSymbolTable().EnterScope( newFor.m_id, 0 );
 }
 
 
@@ -266,12 +281,14 @@ void SourceCode::OpenBrace( const string& line, int column )
 /*************************************************************************************************/
 void SourceCode::UpdateFor( const string& line, int column )
 {
-	if ( m_forStackPtr == 0 )
+	// Only FORs opened by this source code can be closed by it
+
+	if ( static_cast<int>(m_forStack.size()) == m_initialForStackPtr )
 	{
 		throw AsmException_SyntaxError_NextWithoutFor( line, column );
 	}
 
-	For& thisFor = m_forStack[ m_forStackPtr - 1 ];
+	For& thisFor = m_forStack.back();
 
 	// step of 0.0 here means that the 'for' is in fact an open brace, so throw an error
 
@@ -286,18 +303,21 @@ void SourceCode::UpdateFor( const string& line, int column )
 		 ( thisFor.m_step < 0.0 && thisFor.m_current < thisFor.m_end ) )
 	{
 		// we have reached the end of the FOR
-		SymbolTable::Instance().RemoveSymbol( thisFor.m_varName );
-		SymbolTable::Instance().PopScope();
-		m_forStackPtr--;
+		m_context.GetSymbolTable().LeaveScope();
+		m_context.GetSymbolTable().RemoveSymbol( thisFor.m_varName );
+		m_context.GetSymbolTable().PopScope();
+		m_forStack.pop_back();
 	}
 	else
 	{
 		// reloop
-		SymbolTable::Instance().ChangeSymbol( thisFor.m_varName, thisFor.m_current );
+		m_context.GetSymbolTable().ChangeSymbol( thisFor.m_varName, thisFor.m_current );
 		SetFilePointer( thisFor.m_filePtr );
-		SymbolTable::Instance().PopScope();
-		SymbolTable::Instance().PushFor(thisFor.m_varName, thisFor.m_current);
+		m_context.GetSymbolTable().PopScope();
+		m_context.GetSymbolTable().PushFor(thisFor.m_varName, thisFor.m_current);
+		m_context.GetSymbolTable().LeaveScope();
 		thisFor.m_count++;
+		m_context.GetSymbolTable().EnterScope( thisFor.m_id, thisFor.m_count );
 		m_lineNumber = thisFor.m_lineNumber - 1;
 	}
 }
@@ -315,18 +335,18 @@ void SourceCode::CloseBrace( const string& line, int column )
 {
 	// Instead of comparing against 0, I compare with the initial value of the stack ptr when
 	// SourceCode::Process() was called.
-	// This is because macros start wih a copy of the parent FOR stack frame, with an extra set of
+	// This is because macros start on top of the parent's FOR stack frames, with an extra set of
 	// braces pushed so they are in their own scope.  Without this amendment, it'd be possible to
 	// close the 'hidden' braces started by the macro instantiation - with hilarious* consequences!
 	//
 	// * for unfunny values of hilarious
 
-	if ( m_forStackPtr == m_initialForStackPtr )
+	if ( static_cast<int>(m_forStack.size()) == m_initialForStackPtr )
 	{
 		throw AsmException_SyntaxError_MismatchedBraces( line, column );
 	}
 
-	For& thisFor = m_forStack[ m_forStackPtr - 1 ];
+	For& thisFor = m_forStack.back();
 
 	// step of non-0.0 here means that this a real 'for', so throw an error
 
@@ -335,48 +355,37 @@ void SourceCode::CloseBrace( const string& line, int column )
 		throw AsmException_SyntaxError_MismatchedBraces( line, column );
 	}
 
-	SymbolTable::Instance().PopScope();
-	m_forStackPtr--;
+	m_context.GetSymbolTable().PopScope();
+	m_context.GetSymbolTable().LeaveScope();
+	m_forStack.pop_back();
 }
 
 
 /*************************************************************************************************/
 /**
-	SourceCode::CopyForStack()
+	SourceCode::GetScopedSymbolName()
 */
 /*************************************************************************************************/
-void SourceCode::CopyForStack( const SourceCode* copyFrom )
+ScopedSymbolName SourceCode::GetScopedSymbolName( const string& symbolName, int level ) const
 {
-	m_forStackPtr = copyFrom->m_forStackPtr;
-
-	for ( int i = 0; i < m_forStackPtr; i++ )
-	{
-		m_forStack[ i ] = copyFrom->m_forStack[ i ];
-	}
+	return GetScopedSymbolName( SymbolNamePool::Instance().Intern( symbolName ), level );
 }
 
-
-
-/*************************************************************************************************/
-/**
-	SourceCode::GetScopedSymbolName()
-*/
-/*************************************************************************************************/
-ScopedSymbolName SourceCode::GetScopedSymbolName( const string& symbolName, int level ) const
+ScopedSymbolName SourceCode::GetScopedSymbolName( int nameId, int level ) const
 {
 	if ( level == -1 )
 	{
-		level = m_forStackPtr;
+		level = m_forStack.size();
 	}
 
 	int i = level - 1;
 	if ( i >= 0 )
 	{
-		return ScopedSymbolName(symbolName, m_forStack[ i ].m_id, m_forStack[ i ].m_count);
+		return ScopedSymbolName(nameId, m_forStack[ i ].m_id, m_forStack[ i ].m_count);
 	}
 	else
 	{
-		return ScopedSymbolName(symbolName);
+		return ScopedSymbolName(nameId, -1, -1);
 	}
 }
 
@@ -384,20 +393,19 @@ ScopedSymbolName SourceCode::GetScopedSymbolName( const string& symbolName, int
 
 /*************************************************************************************************/
 /**
-	SourceCode::IsIfConditionTrue()
+	SourceCode::SetIfCondition()
+
+	Sets the condition of one of our IF levels, keeping count of those which are false so that
+	IsIfConditionTrue() needn't look through them all
 */
 /*************************************************************************************************/
-bool SourceCode::IsIfConditionTrue() const
+void SourceCode::SetIfCondition( If& ifLevel, bool b )
 {
-	for ( int i = 0; i < m_ifStackPtr; i++ )
+	if ( ifLevel.m_condition != b )
 	{
-		if ( !m_ifStack[ i ].m_condition )
-		{
-			return false;
-		}
+		m_falseIfCount += b ? -1 : 1;
+		ifLevel.m_condition = b;
 	}
-
-	return true;
 }
 
 
@@ -409,19 +417,21 @@ bool SourceCode::IsIfConditionTrue() const
 /*************************************************************************************************/
 void SourceCode::AddIfLevel( const string& line, int column )
 {
-	if ( m_ifStackPtr == MAX_IF_LEVELS )
+	if ( static_cast<int>(m_ifStack.size()) - m_initialIfStackPtr == MAX_IF_LEVELS )
 	{
 		throw AsmException_SyntaxError_TooManyIFs( line, column );
 	}
 
-	m_ifStack[ m_ifStackPtr ].m_condition			= true;
-	m_ifStack[ m_ifStackPtr ].m_passed				= false;
-	m_ifStack[ m_ifStackPtr ].m_hadElse				= false;
-	m_ifStack[ m_ifStackPtr ].m_isMacroDefinition	= false;
-	m_ifStack[ m_ifStackPtr ].m_line				= line;
-	m_ifStack[ m_ifStackPtr ].m_column				= column;
-	m_ifStack[ m_ifStackPtr ].m_lineNumber			= m_lineNumber;
-	m_ifStackPtr++;
+	m_ifStack.push_back( If() );
+	If& newIf = m_ifStack.back();
+
+	newIf.m_condition			= true;
+	newIf.m_passed				= false;
+	newIf.m_hadElse				= false;
+	newIf.m_isMacroDefinition	= false;
+	newIf.m_line				= line;
+	newIf.m_column				= column;
+	newIf.m_lineNumber			= m_lineNumber;
 }
 
 
@@ -433,8 +443,8 @@ void SourceCode::AddIfLevel( const string& line, int column )
 /*************************************************************************************************/
 void SourceCode::SetCurrentIfAsMacroDefinition()
 {
-	assert( m_ifStackPtr > 0 );
-	m_ifStack[ m_ifStackPtr - 1 ].m_isMacroDefinition = true;
+	assert( static_cast<int>(m_ifStack.size()) > m_initialIfStackPtr );
+	m_ifStack.back().m_isMacroDefinition = true;
 }
 
 
@@ -446,11 +456,11 @@ void SourceCode::SetCurrentIfAsMacroDefinition()
 /*************************************************************************************************/
 void SourceCode::SetCurrentIfCondition( bool b )
 {
-	assert( m_ifStackPtr > 0 );
-	m_ifStack[ m_ifStackPtr - 1 ].m_condition = b;
+	assert( static_cast<int>(m_ifStack.size()) > m_initialIfStackPtr );
+	SetIfCondition( m_ifStack.back(), b );
 	if ( b )
 	{
-		m_ifStack[ m_ifStackPtr - 1 ].m_passed = true;
+		m_ifStack.back().m_passed = true;
 	}
 }
 
@@ -463,14 +473,14 @@ void SourceCode::SetCurrentIfCondition( bool b )
 /*************************************************************************************************/
 void SourceCode::StartElse( const string& line, int column )
 {
-	if ( m_ifStack[ m_ifStackPtr - 1 ].m_hadElse )
+	if ( static_cast<int>(m_ifStack.size()) == m_initialIfStackPtr || m_ifStack.back().m_hadElse )
 	{
 		throw AsmException_SyntaxError_ElseWithoutIf( line, column );
 	}
 
-	m_ifStack[ m_ifStackPtr - 1 ].m_hadElse = true;
+	m_ifStack.back().m_hadElse = true;
 
-	m_ifStack[ m_ifStackPtr - 1 ].m_condition = !m_ifStack[ m_ifStackPtr - 1 ].m_passed;
+	SetIfCondition( m_ifStack.back(), !m_ifStack.back().m_passed );
 }
 
 
@@ -482,12 +492,12 @@ void SourceCode::StartElse( const string& line, int column )
 /*************************************************************************************************/
 void SourceCode::StartElif( const string& line, int column )
 {
-	if ( m_ifStack[ m_ifStackPtr - 1 ].m_hadElse )
+	if ( static_cast<int>(m_ifStack.size()) == m_initialIfStackPtr || m_ifStack.back().m_hadElse )
 	{
 		throw AsmException_SyntaxError_ElifWithoutIf( line, column );
 	}
 
-	m_ifStack[ m_ifStackPtr - 1 ].m_condition = !m_ifStack[ m_ifStackPtr - 1 ].m_passed;
+	SetIfCondition( m_ifStack.back(), !m_ifStack.back().m_passed );
 }
 
 
@@ -499,12 +509,13 @@ void SourceCode::StartElif( const string& line, int column )
 /*************************************************************************************************/
 void SourceCode::RemoveIfLevel( const string& line, int column )
 {
-	if ( m_ifStackPtr == 0 )
+	if ( static_cast<int>(m_ifStack.size()) == m_initialIfStackPtr )
 	{
 		throw AsmException_SyntaxError_EndifWithoutIf( line, column );
 	}
 
-	m_ifStackPtr--;
+	SetIfCondition( m_ifStack.back(), true );
+	m_ifStack.pop_back();
 }
 
 
@@ -516,7 +527,7 @@ void SourceCode::RemoveIfLevel( const string& line, int column )
 /*************************************************************************************************/
 void SourceCode::StartMacro( const string& line, int column )
 {
-	if ( GlobalData::Instance().IsFirstPass() )
+	if ( m_context.GetGlobalData().IsFirstPass() )
 	{
 		if ( m_currentMacro == NULL )
 		{
@@ -541,7 +552,7 @@ void SourceCode::StartMacro( const string& line, int column )
 /*************************************************************************************************/
 void SourceCode::EndMacro( const string& line, int column )
 {
-	if ( GlobalData::Instance().IsFirstPass() &&
+	if ( m_context.GetGlobalData().IsFirstPass() &&
 		 m_currentMacro == NULL )
 	{
 		throw AsmException_SyntaxError_EndMacroUnexpected( line, column - 8 );
@@ -549,7 +560,7 @@ void SourceCode::EndMacro( const string& line, int column )
 
 	RemoveIfLevel( line, column );
 
-	if ( GlobalData::Instance().IsFirstPass() )
+	if ( m_context.GetGlobalData().IsFirstPass() )
 	{
 		if ( m_currentMacro->GetName().empty() )
 		{
@@ -558,7 +569,7 @@ void SourceCode::EndMacro( const string& line, int column )
 		}
 		else
 		{
-			MacroTable::Instance().Add( m_currentMacro );
+			m_context.GetMacroTable().Add( m_currentMacro );
 		}
 		m_currentMacro = NULL;
 	}
@@ -577,7 +588,7 @@ void SourceCode::EndMacro( const string& line, int column )
 bool SourceCode::IsRealForLevel( int level ) const
 {
         assert( level > 0 );
-        assert( level <= m_forStackPtr );
+        assert( level <= static_cast<int>(m_forStack.size()) );
         return m_forStack[ level - 1 ].m_step != 0.0;
 }
 
@@ -592,17 +603,15 @@ bool SourceCode::IsRealForLevel( int level ) const
 /*************************************************************************************************/
 bool SourceCode::GetSymbolValue(const std::string& name, Value& value)
 {
-	for ( int forLevel = GetForLevel(); forLevel >= 0; forLevel-- )
-	{
-		ScopedSymbolName fullSymbolName = GetScopedSymbolName( name, forLevel );
+	return GetSymbolValue( SymbolNamePool::Instance().Intern( name ), value );
+}
 
-		if ( SymbolTable::Instance().IsSymbolDefined( fullSymbolName ) )
-		{
-			value = SymbolTable::Instance().GetSymbol( fullSymbolName );
-			return true;
-		}
-	}
-	return false;
+bool SourceCode::GetSymbolValue(int nameId, Value& value)
+{
+	// The symbol table keeps track of the same chain of scopes as our FOR stack
+	assert( m_context.GetSymbolTable().GetScopeLevel() == GetForLevel() );
+
+	return m_context.GetSymbolTable().GetInnermostSymbol( nameId, value );
 }
 
 
@@ -616,23 +625,18 @@ bool SourceCode::GetSymbolValue(const std::string& name, Value& value)
 /*************************************************************************************************/
 bool SourceCode::ShouldOutputAsm()
 {
-	if (!GlobalData::Instance().IsSecondPass())
+	if (!m_context.GetGlobalData().IsSecondPass())
 		return false;
 
-	if (GlobalData::Instance().IsVerboseSet())
+	if (m_context.GetGlobalData().IsVerboseSet())
 	{
-		return GlobalData::Instance().IsVerbose();
+		return m_context.GetGlobalData().IsVerbose();
 	}
 
-	Value value;
-	if ( GetSymbolValue("VERBOSE", value) )
-	{
-		if (value.GetType() != Value::NumberValue)
-			return false;
-		return value.GetNumber() != 0;
-	}
+	// The symbol table keeps track of the same chain of scopes as our FOR stack
+	assert( m_context.GetSymbolTable().GetScopeLevel() == GetForLevel() );
 
-	return false;
+	return m_context.GetSymbolTable().IsVerboseSymbolSet();
 }
 
 
@@ -641,24 +645,19 @@ bool SourceCode::ShouldOutputAsm()
 /**
 	SourceCode::GetLine()
 
-	Reads a line from the source code and returns it into lineFromFile
+	Returns the next line from the source code, or NULL at the end.  The line is only split out
+	and lexed the first time it is seen; after that it comes straight from the line cache.
 */
 /*************************************************************************************************/
-bool SourceCode::GetLine( string& lineFromFile )
+LexedLine* SourceCode::GetLine()
 {
 	if (IsAtEnd())
 	{
-		return false;
-	}
-	// Check there is always a trailing '\n' (the constructor should ensure this)
-	assert(m_text.back() == '\n');
-	int begin = m_textPointer;
-	while (m_text[m_textPointer++] != '\n')
-	{
+		return NULL;
 	}
-	// Adding the line in one go rather than character by character is very much faster
-	lineFromFile.assign(m_text.cbegin() + begin, m_text.cbegin() + m_textPointer - 1);
-	return true;
+	LexedLine& line = m_lineCache->GetLine(*m_text, m_textPointer);
+	m_textPointer = line.GetNextLinePointer();
+	return &line;
 }
 
 
@@ -672,10 +671,10 @@ bool SourceCode::GetLine( string& lineFromFile )
 /*************************************************************************************************/
 void SourceCode::SetFilePointer( int i )
 {
-	if (i > static_cast<int>(m_text.length()))
+	if (i > static_cast<int>(m_text->length()))
 	{
 		assert(false);
-		i = m_text.length();
+		i = m_text->length();
 	}
 	m_lineStartPointer = i;
 	m_textPointer = i;
@@ -23,11 +23,15 @@
 #ifndef SOURCECODE_H_
 #define SOURCECODE_H_
 
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "linecache.h"
 #include "scopedsymbolname.h"
 #include "value.h"
 
+class AssemblyContext;
 class Macro;
 
 class SourceCode
@@ -36,7 +40,7 @@ public:
 
 	// Constructor/destructor
 
-	SourceCode( const std::string& filename, int lineNumber, const std::string& text, const SourceCode* parent );
+	SourceCode( AssemblyContext& context, const std::string& filename, int lineNumber, const SourceText& text, LineCache& lineCache, const SourceCode* parent );
 	~SourceCode();
 
 	// Process the file
@@ -45,25 +49,27 @@ public:
 
 	// Accessors
 
+	inline AssemblyContext&	GetContext() const				{ return m_context; }
 	inline const std::string&	GetFilename() const				{ return m_filename; }
 	inline int				GetLineNumber() const			{ return m_lineNumber; }
 	inline const SourceCode*GetParent() const				{ return m_parent; }
 	inline int				GetLineStartPointer() const		{ return m_lineStartPointer; }
 
-	virtual bool			GetLine( std::string& lineFromFile );
+	virtual LexedLine*		GetLine();
 	virtual int				GetFilePointer() { return m_textPointer; }
 	virtual void			SetFilePointer( int i );
-	virtual bool			IsAtEnd() { return m_textPointer == static_cast<int>(m_text.length()); }
+	virtual bool			IsAtEnd() { return m_textPointer == static_cast<int>(m_text->length()); }
 
 
 	// For loop / if related stuff
-	// Should use a std::vector here, but I can't really be bothered to change it now
 
 	#define MAX_FOR_LEVELS	256
 	#define MAX_IF_LEVELS	256
 
 protected:
 
+	AssemblyContext&		m_context;
+
 	struct For
 	{
 		ScopedSymbolName	m_varName;
@@ -78,8 +84,6 @@ protected:
 		int					m_lineNumber;
 	};
 
-	For						m_forStack[ MAX_FOR_LEVELS ];
-	int						m_forStackPtr;
 	int						m_initialForStackPtr;
 
 	struct If
@@ -93,9 +97,23 @@ protected:
 		int					m_lineNumber;
 	};
 
-	int						m_ifStackPtr;
 	int						m_initialIfStackPtr;
-	If						m_ifStack[ MAX_IF_LEVELS ];
+	int						m_falseIfCount;			// our IF levels whose condition is false
+
+	// The FOR and IF stacks are shared by a source file and every file and macro instance
+	// processed from it, each of which only works on the levels above those open when it
+	// started.  So instancing a macro doesn't need to copy its parent's FOR stack.
+	struct ScopeStacks
+	{
+		std::vector<For>	m_forStack;
+		std::vector<If>		m_ifStack;
+	};
+
+	std::unique_ptr<ScopeStacks>	m_ownStacks;		// only set for the outermost source file
+	std::vector<For>&		m_forStack;
+	std::vector<If>&		m_ifStack;
+
+	void					SetIfCondition( If& ifLevel, bool b );
 
 	Macro*					m_currentMacro;
 
@@ -115,18 +133,18 @@ public:
 
 	void					UpdateFor( const std::string& line, int column );
 
-	void					CopyForStack( const SourceCode* copyFrom );
-
-	inline int 				GetForLevel() const { return m_forStackPtr; }
+	inline int 				GetForLevel() const { return static_cast<int>(m_forStack.size()); }
 	inline int 				GetInitialForStackPtr() const { return m_initialForStackPtr; }
 	inline Macro*			GetCurrentMacro() { return m_currentMacro; }
 
 	bool					GetSymbolValue(const std::string& name, Value& value);
+	bool					GetSymbolValue(int nameId, Value& value);
 	ScopedSymbolName		GetScopedSymbolName( const std::string& symbolName, int level = -1 ) const;
+	ScopedSymbolName		GetScopedSymbolName( int nameId, int level = -1 ) const;
 
 	bool					ShouldOutputAsm();
 
-	bool					IsIfConditionTrue() const;
+	inline bool				IsIfConditionTrue() const { return m_falseIfCount == 0; }
 	void					AddIfLevel( const std::string& line, int column );
 	void					SetCurrentIfAsMacroDefinition();
 	void					SetCurrentIfCondition( bool b );
@@ -148,7 +166,8 @@ protected:
 	int						m_lineNumber;
 	const SourceCode*		m_parent;
 	int						m_lineStartPointer;
-	std::string				m_text;
+	SourceText				m_text;
+	LineCache*				m_lineCache;
 	int						m_textPointer;
 };
 
@@ -22,14 +22,16 @@
 */
 /*************************************************************************************************/
 
-#include <fstream>
 #include <iostream>
 
 #include "sourcefile.h"
+#include "assemblycontext.h"
 #include "asmexception.h"
+#include "filecache.h"
 #include "stringutils.h"
 #include "globaldata.h"
 #include "lineparser.h"
+#include "linecache.h"
 #include "symboltable.h"
 
 
@@ -38,85 +40,67 @@ using namespace std;
 
 /*************************************************************************************************/
 /**
-	ReadFile()
+	ReadFileCache()
 
-	Read a file into a string.  Convert tabs to spaces and
-	normalise line endings (\r, \r\n or \n) to \n.
+	Read a file and return the line cache which holds it.  The context supplies its text,
+	with tabs converted to spaces and line endings (\r, \r\n or \n) normalised to \n.
 
+	@param		context			The assembly the file is being read for
 	@param		filename		Filename of source file to open
 
-	The supplied file will be opened.  If there is a problem, an AsmException will be thrown.
+	If there is a problem, an AsmException will be thrown.
 */
 /*************************************************************************************************/
-static string ReadFile( const string& filename )
+static LineCache& ReadFileCache( AssemblyContext& context, const string& filename )
 {
-	// we have to open in binary, due to a bug in MinGW which means that calling
-	// tellg() on a text-mode file ruins the file pointer!
-	// http://www.mingw.org/MinGWiki/index.php/Known%20Problems
-	std::ifstream file;
-	file.open( filename.c_str(), ios_base::binary );
+	SourceText text = context.GetSourceText( filename );
 
-	if ( !file )
+	if ( !text )
 	{
 		throw AsmException_FileError_OpenSourceFile( filename );
 	}
 
-	file.seekg(0, std::ios_base::end);
-	unsigned int length = static_cast<unsigned int>(file.tellg());
-	file.seekg(0, std::ios_base::beg);
+	return context.GetLineCacheTable().GetFileCache( filename, text );
+}
 
-	string blob;
-	blob.reserve(length + 1); // Extra 1 for trailing '\n'
 
-	std::istream::sentry sentry(file, true);
-	std::streambuf* sb = file.rdbuf();
 
-	while (true)
-	{
-		std::ifstream::int_type c = sb->sbumpc();
-		if (c == '\t')
-		{
-			blob.push_back(' ');
-		}
-		else if (c == '\r')
-		{
-			std::ifstream::int_type next = sb->sgetc();
-			if (next != '\n')
-			{
-				blob.push_back('\n');
-			}
-		}
-		else if (c == std::ifstream::traits_type::eof())
-		{
-			break;
-		}
-		else
-		{
-			blob.push_back(c);
-		}
-	}
-	if (blob.length() == 0 || blob[blob.length() - 1] != '\n')
-	{
-		blob.append("\n");
-	}
+/*************************************************************************************************/
+/**
+	SourceFile::SourceFile()
+
+	Constructor for SourceFile
 
-	return blob;
+	@param		context			The assembly the file is part of
+	@param		filename		Filename of source file to open
+	@param		parent			Parent SourceCode object (or null)
+
+	The supplied file will be opened.  If there is a problem, an AsmException will be thrown.
+*/
+/*************************************************************************************************/
+SourceFile::SourceFile( AssemblyContext& context, const string& filename, const SourceCode* parent )
+	:	SourceFile( context, filename, ReadFileCache( context, filename ), parent )
+{
 }
 
+
+
 /*************************************************************************************************/
 /**
 	SourceFile::SourceFile()
 
-	Constructor for SourceFile
+	Constructor for SourceFile, once the file has been read
 
-	@param		filename		Filename of source file to open
+	@param		context			The assembly the file is part of
+	@param		filename		Filename of source file
+	@param		lineCache		Line cache holding the contents of the source file
 	@param		parent			Parent SourceCode object
 
-	The supplied file will be opened.  If there is a problem, an AsmException will be thrown.
+	The text, and lines lexed by an earlier pass over the same file, are shared with the cache.
 */
 /*************************************************************************************************/
-SourceFile::SourceFile( const string& filename, const SourceCode* parent )
-	:	SourceCode( filename, 1, ReadFile( filename ), parent )
+SourceFile::SourceFile( AssemblyContext& context, const string& filename, LineCache& lineCache, const SourceCode* parent )
+	:	SourceCode( context, filename, 1, lineCache.GetText(), lineCache, parent )
 {
 }
 
@@ -151,6 +135,6 @@ void SourceFile::Process()
 
 	if ( ShouldOutputAsm() )
 	{
-		cerr << "Processed file '" << m_filename << "' ok" << endl;
+		m_context.GetErrors() << "Processed file '" << m_filename << "' ok" << endl;
 	}
 }
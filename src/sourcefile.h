@@ -35,10 +35,14 @@ public:
 
 	// Constructor/destructor (RAII class)
 
-	SourceFile( const std::string& filename, const SourceCode* parent );
+	SourceFile( AssemblyContext& context, const std::string& filename, const SourceCode* parent );
 	virtual ~SourceFile();
 
 	virtual void Process();
+
+private:
+
+	SourceFile( AssemblyContext& context, const std::string& filename, LineCache& lineCache, const SourceCode* parent );
 };
 
 
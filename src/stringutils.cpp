@@ -22,7 +22,6 @@
 
 #include <iostream>
 #include <sstream>
-#include "globaldata.h"
 #include "stringutils.h"
 
 using namespace std;
@@ -70,14 +69,15 @@ bool EatWhitespace( const string& line, size_t& column )
 
 	@param		filename		Filename
 	@param		lineNumber		Line number
+	@param		useVisualCppErrorFormat		Whether to use the Visual C++ format, file(line)
 
 	@return		string			Error location string
 */
 /*************************************************************************************************/
-std::string FormattedErrorLocation( const std::string& filename, int lineNumber )
+std::string FormattedErrorLocation( const std::string& filename, int lineNumber, bool useVisualCppErrorFormat )
 {
 	std::stringstream s;
-	if ( GlobalData::Instance().UseVisualCppErrorFormat() )
+	if ( useVisualCppErrorFormat )
 	{
 		s << filename << "(" << lineNumber << ")";
 	}
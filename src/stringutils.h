@@ -29,7 +29,7 @@
 namespace StringUtils
 {
 	bool EatWhitespace( const std::string& line, size_t& column );
-	std::string FormattedErrorLocation ( const std::string& filename, int lineNumber );
+	std::string FormattedErrorLocation ( const std::string& filename, int lineNumber, bool useVisualCppErrorFormat );
 	void PrintNumber(std::ostream& dest, double value);
 }
 
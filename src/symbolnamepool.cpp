@@ -0,0 +1,119 @@
+/*************************************************************************************************/
+/**
+	symbolnamepool.cpp
+
+	Interns symbol names as integer ids
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#include "symbolnamepool.h"
+
+
+using namespace std;
+
+
+SymbolNamePool* SymbolNamePool::m_gInstance = NULL;
+
+
+/*************************************************************************************************/
+/**
+	SymbolNamePool::Create()
+
+	Creates the SymbolNamePool singleton
+*/
+/*************************************************************************************************/
+void SymbolNamePool::Create()
+{
+	assert( m_gInstance == NULL );
+
+	m_gInstance = new SymbolNamePool;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolNamePool::Destroy()
+
+	Destroys the SymbolNamePool singleton
+*/
+/*************************************************************************************************/
+void SymbolNamePool::Destroy()
+{
+	assert( m_gInstance != NULL );
+
+	delete m_gInstance;
+	m_gInstance = NULL;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolNamePool::SymbolNamePool()
+
+	SymbolNamePool constructor
+*/
+/*************************************************************************************************/
+SymbolNamePool::SymbolNamePool()
+{
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolNamePool::~SymbolNamePool()
+
+	SymbolNamePool destructor
+*/
+/*************************************************************************************************/
+SymbolNamePool::~SymbolNamePool()
+{
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolNamePool::Intern()
+
+	Returns the id of a symbol name, allocating a new one if it hasn't been seen before
+
+	@param		name			The symbol name
+	@returns	int
+*/
+/*************************************************************************************************/
+int SymbolNamePool::Intern( const string& name )
+{
+	lock_guard< mutex > lock( m_mutex );
+
+	unordered_map< string, int >::const_iterator it = m_ids.find( name );
+
+	if ( it != m_ids.end() )
+	{
+		return it->second;
+	}
+
+	int id = static_cast< int >( m_names.size() );
+	m_names.push_back( name );
+	m_ids.insert( make_pair( name, id ) );
+
+	return id;
+}
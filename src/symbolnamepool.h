@@ -0,0 +1,68 @@
+/*************************************************************************************************/
+/**
+	symbolnamepool.h
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#ifndef SYMBOLNAMEPOOL_H_
+#define SYMBOLNAMEPOOL_H_
+
+#include <cassert>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+// Interns symbol names, so that the symbol table can refer to them by a small integer id, and
+// compare and hash them without touching the string.  The pool is shared by every assembly in
+// the process, which may be running on different threads.
+class SymbolNamePool
+{
+public:
+
+	static void Create();
+	static void Destroy();
+	static inline SymbolNamePool& Instance() { assert( m_gInstance != NULL ); return *m_gInstance; }
+
+	int Intern( const std::string& name );
+
+	inline const std::string& GetName( int id ) const
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		assert( id >= 0 && id < static_cast< int >( m_names.size() ) );
+		return m_names[ id ];
+	}
+
+private:
+
+	SymbolNamePool();
+	~SymbolNamePool();
+
+	std::deque< std::string >					m_names;		// by id; a deque so references stay valid
+	std::unordered_map< std::string, int >		m_ids;
+	mutable std::mutex							m_mutex;		// guards both of the above
+
+	static SymbolNamePool*						m_gInstance;
+};
+
+
+
+#endif // SYMBOLNAMEPOOL_H_
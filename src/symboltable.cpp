@@ -22,7 +22,6 @@
 
 #include <cmath>
 #include <cstdio>
-#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <algorithm>
@@ -30,65 +29,54 @@
 #include "globaldata.h"
 #include "objectcode.h"
 #include "symboltable.h"
+#include "assemblycontext.h"
+#include "symbolnamepool.h"
 #include "constants.h"
 #include "asmexception.h"
+#include "beebasm.h"
 #include "literals.h"
+#include "outputfile.h"
 #include "stringutils.h"
 
 
 using namespace std;
 
 
-SymbolTable* SymbolTable::m_gInstance = NULL;
-
-
-/*************************************************************************************************/
-/**
-	SymbolTable::Create()
-
-	Creates the SymbolTable singleton
-*/
-/*************************************************************************************************/
-void SymbolTable::Create()
-{
-	assert( m_gInstance == NULL );
-
-	m_gInstance = new SymbolTable;
-}
-
-
-
 /*************************************************************************************************/
 /**
-	SymbolTable::Destroy()
+	GetProgramCounter()
 
-	Destroys the SymbolTable singleton
+	Computes the value of P%, which is always the current PC
 */
 /*************************************************************************************************/
-void SymbolTable::Destroy()
+static Value GetProgramCounter( AssemblyContext& context )
 {
-	assert( m_gInstance != NULL );
-
-	delete m_gInstance;
-	m_gInstance = NULL;
+	return static_cast< double >( context.GetObjectCode().GetPC() );
 }
 
 
-
 /*************************************************************************************************/
 /**
 	SymbolTable::SymbolTable()
 
 	SymbolTable constructor
+
+	@param		context			The assembly this symbol table belongs to
 */
 /*************************************************************************************************/
-SymbolTable::SymbolTable()
-	:	m_labelScopes( 0 )
+SymbolTable::SymbolTable( AssemblyContext& context )
+	:	m_context( context ),
+		m_slots( 256 ),
+		m_numSymbols( 0 ),
+		m_openScopes( 1, ScopeKey( -1, -1 ) ),
+		m_verboseNameId( SymbolNamePool::Instance().Intern( "VERBOSE" ) ),
+		m_verboseState( VERBOSE_UNKNOWN ),
+		m_labelScopes( 0 )
 {
 	// Add any constant symbols here
 
 	AddBuiltInSymbol( "PI", const_pi );
-	AddBuiltInSymbol( "P%", 0 );
+	AddComputedBuiltInSymbol( "P%", &GetProgramCounter );
 	AddBuiltInSymbol( "TRUE", -1 );
 	AddBuiltInSymbol( "FALSE", 0 );
 }
@@ -120,7 +108,55 @@ SymbolTable::~SymbolTable()
 /*************************************************************************************************/
 bool SymbolTable::IsSymbolDefined( const ScopedSymbolName& symbol ) const
 {
-	return m_map.find( symbol ) != m_map.cend();
+	return m_slots[ FindSlot( symbol ) ].m_used;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolTable::FindSlot()
+
+	Finds the slot in the hash table holding a symbol, or the empty slot where it would go
+
+	@param		symbol			The symbol to search for
+	@returns	size_t
+*/
+/*************************************************************************************************/
+size_t SymbolTable::FindSlot( const ScopedSymbolName& symbol ) const
+{
+	size_t mask = m_slots.size() - 1;
+	size_t i = symbol.Hash() & mask;
+
+	while ( m_slots[ i ].m_used && m_slots[ i ].m_name != symbol )
+	{
+		i = ( i + 1 ) & mask;
+	}
+
+	return i;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolTable::Grow()
+
+	Doubles the size of the hash table, rehashing the symbols into it
+*/
+/*************************************************************************************************/
+void SymbolTable::Grow()
+{
+	vector<Slot> oldSlots( m_slots.size() * 2 );
+	oldSlots.swap( m_slots );
+
+	for ( vector<Slot>::const_iterator it = oldSlots.begin(); it != oldSlots.end(); ++it )
+	{
+		if ( it->m_used )
+		{
+			m_slots[ FindSlot( it->m_name ) ] = *it;
+		}
+	}
 }
 
 
@@ -142,6 +178,25 @@ void SymbolTable::AddBuiltInSymbol( const string& name, Value value )
 
 
 
+/*************************************************************************************************/
+/**
+	SymbolTable::AddComputedBuiltInSymbol()
+
+	Adds a unscoped symbol to the symbol table whose value is computed whenever it is referenced,
+	so it needn't be updated as the thing it reflects changes
+
+	@param		symbol			The symbol to add
+	@param		computedValue	Function returning its value
+*/
+/*************************************************************************************************/
+void SymbolTable::AddComputedBuiltInSymbol( const string& name, ComputedValue computedValue )
+{
+	AddSymbol(ScopedSymbolName(name), 0);
+	m_slots[ FindSlot( ScopedSymbolName(name) ) ].m_symbol = Symbol( computedValue );
+}
+
+
+
 /*************************************************************************************************/
 /**
 	SymbolTable::AddSymbol()
@@ -155,7 +210,19 @@ void SymbolTable::AddBuiltInSymbol( const string& name, Value value )
 void SymbolTable::AddSymbol( const ScopedSymbolName& symbol, Value value, bool isLabel )
 {
 	assert( !IsSymbolDefined( symbol ) );
-	m_map.insert( make_pair( symbol, Symbol( value, isLabel ) ) );
+
+	if ( ( m_numSymbols + 1 ) * 2 > m_slots.size() )
+	{
+		Grow();
+	}
+
+	Slot& slot = m_slots[ FindSlot( symbol ) ];
+	slot.m_name = symbol;
+	slot.m_symbol = Symbol( value, isLabel );
+	slot.m_used = true;
+	m_numSymbols++;
+
+	Bind( symbol );
 }
 
 
@@ -229,7 +296,7 @@ bool SymbolTable::AddCommandLineSymbol( const std::string& expr )
 		return false;
 	}
 
-	m_map.insert( make_pair( symbol, Symbol( value, false ) ) );
+	AddSymbol( ScopedSymbolName( symbol ), value );
 
 	return true;
 }
@@ -266,7 +333,10 @@ bool SymbolTable::AddCommandLineStringSymbol( const std::string& expr )
 
 	String value = String(valueString.data(), valueString.length());
 
-	m_map.insert( make_pair( symbol, Symbol( value, false ) ) );
+	if ( !IsSymbolDefined( ScopedSymbolName( symbol ) ) )
+	{
+		AddSymbol( ScopedSymbolName( symbol ), value );
+	}
 
 	return true;
 }
@@ -283,60 +353,287 @@ bool SymbolTable::AddCommandLineStringSymbol( const std::string& expr )
 /*************************************************************************************************/
 Value SymbolTable::GetSymbol( const ScopedSymbolName& symbol ) const
 {
-	assert( IsSymbolDefined( symbol ) );
-	return m_map.find( symbol )->second.GetValue();
+	const Slot& slot = m_slots[ FindSlot( symbol ) ];
+	assert( slot.m_used );
+	return slot.m_symbol.GetValue( m_context );
 }
 
 
 
 /*************************************************************************************************/
 /**
-	SymbolTable::ChangeBuiltInSymbol()
+	SymbolTable::ChangeSymbol()
 
-	Changes the value of an unscoped symbol which already exists in the symbol table
+	Changes the value of a scoped symbol which already exists in the symbol table
 
-	@param		symbolName		The name of the symbol to look for
+	@param		symbol			The name and scope of the symbol to look for
 	@param		value			Its new value
 */
 /*************************************************************************************************/
-void SymbolTable::ChangeBuiltInSymbol( const std::string& symbolName, double value )
+void SymbolTable::ChangeSymbol( const ScopedSymbolName& symbol, Value value )
 {
-	ChangeSymbol(ScopedSymbolName(symbolName), value);
+	Slot& slot = m_slots[ FindSlot( symbol ) ];
+	assert( slot.m_used );
+	slot.m_symbol.SetValue( value );
+
+	ForgetVerboseState( symbol.NameId() );
 }
 
 
 
 /*************************************************************************************************/
 /**
-	SymbolTable::ChangeSymbol()
+	SymbolTable::RemoveSymbol()
 
-	Changes the value of a scoped symbol which already exists in the symbol table
+	Removes the named symbol
 
-	@param		symbol			The name and scope of the symbol to look for
-	@param		value			Its new value
+	@param		symbol			The name of the symbol to look for
 */
 /*************************************************************************************************/
-void SymbolTable::ChangeSymbol( const ScopedSymbolName& symbol, Value value )
+void SymbolTable::RemoveSymbol( const ScopedSymbolName& symbol )
 {
-	assert( IsSymbolDefined( symbol ) );
-	m_map.find( symbol )->second.SetValue( value );
+	Unbind( symbol );
+
+	size_t mask = m_slots.size() - 1;
+	size_t i = FindSlot( symbol );
+	assert( m_slots[ i ].m_used );
+
+	// Shift back any following symbols which would no longer be found past the gap
+
+	size_t j = i;
+	for (;;)
+	{
+		j = ( j + 1 ) & mask;
+
+		if ( !m_slots[ j ].m_used )
+		{
+			break;
+		}
+
+		size_t home = m_slots[ j ].m_name.Hash() & mask;
+
+		// the symbol at j can move to the gap at i unless its home lies cyclically in (i, j]
+		if ( ( i < j ) ? ( home <= i || home > j ) : ( home <= i && home > j ) )
+		{
+			m_slots[ i ] = m_slots[ j ];
+			i = j;
+		}
+	}
+
+	m_slots[ i ] = Slot();
+	m_numSymbols--;
 }
 
 
 
 /*************************************************************************************************/
 /**
-	SymbolTable::RemoveSymbol()
+	SymbolTable::EnterScope()
 
-	Removes the named symbol
+	Opens a scope (a FOR iteration or a pair of braces), so that its symbols, including any
+	defined on the first pass, take priority over those in outer scopes
 
-	@param		symbol			The name of the symbol to look for
+	@param		id				The scope identifier
+	@param		count			The FOR loop count
 */
 /*************************************************************************************************/
-void SymbolTable::RemoveSymbol( const ScopedSymbolName& symbol )
+void SymbolTable::EnterScope( int id, int count )
+{
+	int level = static_cast< int >( m_openScopes.size() );
+	m_openScopes.push_back( ScopeKey( id, count ) );
+
+	unordered_map< long long, vector<int> >::const_iterator it = m_scopeNames.find( PackScopeKey( id, count ) );
+
+	if ( it != m_scopeNames.end() )
+	{
+		for ( vector<int>::const_iterator name = it->second.begin(); name != it->second.end(); ++name )
+		{
+			m_bindings[ *name ].push_back( level );
+			ForgetVerboseState( *name );
+		}
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolTable::LeaveScope()
+
+	Closes the innermost scope
+*/
+/*************************************************************************************************/
+void SymbolTable::LeaveScope()
+{
+	assert( m_openScopes.size() > 1 );
+
+	const ScopeKey& scope = m_openScopes.back();
+
+	unordered_map< long long, vector<int> >::const_iterator it = m_scopeNames.find( PackScopeKey( scope.first, scope.second ) );
+
+	if ( it != m_scopeNames.end() )
+	{
+		for ( vector<int>::const_iterator name = it->second.begin(); name != it->second.end(); ++name )
+		{
+			assert( m_bindings[ *name ].back() == static_cast< int >( m_openScopes.size() ) - 1 );
+			m_bindings[ *name ].pop_back();
+			ForgetVerboseState( *name );
+		}
+	}
+
+	m_openScopes.pop_back();
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolTable::GetInnermostSymbol()
+
+	Gets the value of a symbol from the innermost open scope which defines it
+
+	@param		nameId			The name of the symbol, in the SymbolNamePool
+	@param		value			Receives its value
+	@returns	bool			false if no open scope defines it
+*/
+/*************************************************************************************************/
+bool SymbolTable::GetInnermostSymbol( int nameId, Value& value ) const
+{
+	if ( nameId >= static_cast< int >( m_bindings.size() ) || m_bindings[ nameId ].empty() )
+	{
+		return false;
+	}
+
+	const ScopeKey& scope = m_openScopes[ m_bindings[ nameId ].back() ];
+	const Slot& slot = m_slots[ FindSlot( ScopedSymbolName( nameId, scope.first, scope.second ) ) ];
+	assert( slot.m_used );
+
+	value = slot.m_symbol.GetValue( m_context );
+	return true;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolTable::UpdateVerboseState()
+
+	Works out whether the innermost VERBOSE symbol is a non-zero number
+*/
+/*************************************************************************************************/
+void SymbolTable::UpdateVerboseState() const
 {
-	assert( IsSymbolDefined( symbol ) );
-	m_map.erase( symbol );
+	Value value;
+
+	if ( GetInnermostSymbol( m_verboseNameId, value ) &&
+		 value.GetType() == Value::NumberValue &&
+		 value.GetNumber() != 0 )
+	{
+		m_verboseState = VERBOSE_ON;
+	}
+	else
+	{
+		m_verboseState = VERBOSE_OFF;
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolTable::FindOpenScope()
+
+	Returns the level of the open scope a symbol belongs to, or -1 if its scope isn't open
+*/
+/*************************************************************************************************/
+int SymbolTable::FindOpenScope( const ScopedSymbolName& symbol ) const
+{
+	// Symbols are nearly always defined in the innermost scope, so search outwards
+
+	for ( int level = static_cast< int >( m_openScopes.size() ) - 1; level >= 0; level-- )
+	{
+		if ( m_openScopes[ level ].first == symbol.ScopeId() && m_openScopes[ level ].second == symbol.Count() )
+		{
+			return level;
+		}
+	}
+
+	return -1;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolTable::Bind()
+
+	Records a newly added symbol against its scope, and binds it if the scope is open
+*/
+/*************************************************************************************************/
+void SymbolTable::Bind( const ScopedSymbolName& symbol )
+{
+	int nameId = symbol.NameId();
+
+	if ( nameId >= static_cast< int >( m_bindings.size() ) )
+	{
+		m_bindings.resize( nameId + 1 );
+	}
+
+	if ( !symbol.TopLevel() )
+	{
+		m_scopeNames[ PackScopeKey( symbol.ScopeId(), symbol.Count() ) ].push_back( nameId );
+	}
+
+	int level = FindOpenScope( symbol );
+
+	if ( level != -1 )
+	{
+		// keep the bindings ordered by level; usually this is the innermost
+
+		vector<int>& bindings = m_bindings[ nameId ];
+		vector<int>::iterator it = bindings.end();
+
+		while ( it != bindings.begin() && *( it - 1 ) > level )
+		{
+			--it;
+		}
+
+		bindings.insert( it, level );
+		ForgetVerboseState( nameId );
+	}
+}
+
+
+
+/*************************************************************************************************/
+/**
+	SymbolTable::Unbind()
+
+	Removes a symbol which is about to be removed from its scope and its bindings
+*/
+/*************************************************************************************************/
+void SymbolTable::Unbind( const ScopedSymbolName& symbol )
+{
+	int nameId = symbol.NameId();
+
+	if ( !symbol.TopLevel() )
+	{
+		vector<int>& names = m_scopeNames[ PackScopeKey( symbol.ScopeId(), symbol.Count() ) ];
+		vector<int>::reverse_iterator it = find( names.rbegin(), names.rend(), nameId );
+		assert( it != names.rend() );
+		names.erase( ( it + 1 ).base() );
+	}
+
+	int level = FindOpenScope( symbol );
+
+	if ( level != -1 )
+	{
+		vector<int>& bindings = m_bindings[ nameId ];
+		vector<int>::reverse_iterator it = find( bindings.rbegin(), bindings.rend(), level );
+		assert( it != bindings.rend() );
+		bindings.erase( ( it + 1 ).base() );
+		ForgetVerboseState( nameId );
+	}
 }
 
 
@@ -345,13 +642,14 @@ void SymbolTable::RemoveSymbol( const ScopedSymbolName& symbol )
 /**
 	SymbolTable::Dump()
 
-	Dumps all global symbols in the symbol table
+	Dumps all global symbols in the symbol table, to the output or to a labels file, which is
+	left alone if it hasn't changed
 */
 /*************************************************************************************************/
 void SymbolTable::Dump(bool global, bool all, const char * labels_file) const
 {
-	std::ofstream labels;
-	std::ostream & our_cout = (labels_file && (labels.open(labels_file), !labels.bad())) ? labels : std::cout;
+	std::ostringstream labels;
+	std::ostream & our_cout = labels_file ? labels : m_context.GetOutput();
 
 	our_cout << "[{";
 
@@ -362,16 +660,21 @@ void SymbolTable::Dump(bool global, bool all, const char * labels_file) const
 		typedef vector< pair<double, ScopedSymbolName> > ListType;
 		ListType list;
 
-		for ( MapType::const_iterator it = m_map.begin(); it != m_map.end(); ++it )
+		for ( vector<Slot>::const_iterator it = m_slots.begin(); it != m_slots.end(); ++it )
 		{
-			const ScopedSymbolName&	symbolName = it->first;
-			const Symbol&	symbol = it->second;
+			if ( !it->m_used )
+			{
+				continue;
+			}
+
+			const ScopedSymbolName&	symbolName = it->m_name;
+			const Symbol&	symbol = it->m_symbol;
 
 			if ( symbol.IsLabel() &&
 				 symbolName.TopLevel() )
 			{
 				// This doesn't output string valued symbols
-				Value value = symbol.GetValue();
+				Value value = symbol.GetValue( m_context );
 				if (value.GetType() == Value::NumberValue)
 				{
 					list.push_back( ListType::value_type(value.GetNumber(), symbolName) );
@@ -406,13 +709,73 @@ void SymbolTable::Dump(bool global, bool all, const char * labels_file) const
 	}
 
 	our_cout << "}]" << endl;
+
+	if ( labels_file && OutputFile::WriteIfChanged( labels_file, labels.str() ) == OutputFile::OPEN_FAILED )
+	{
+		m_context.GetOutput() << labels.str();
+	}
+}
+
+
+
+static bool SymbolNameLess( const BeebAsm::Symbol& a, const BeebAsm::Symbol& b )
+{
+	return a.m_name < b.m_name;
 }
 
+
+
+/*************************************************************************************************/
+/**
+	SymbolTable::GetTopLevelSymbols()
+
+	Lists the symbols defined outside any scope, with their values, sorted by name
+
+	@param		symbols			Receives the symbols
+*/
+/*************************************************************************************************/
+void SymbolTable::GetTopLevelSymbols( vector< BeebAsm::Symbol >& symbols ) const
+{
+	symbols.clear();
+
+	for ( vector<Slot>::const_iterator it = m_slots.begin(); it != m_slots.end(); ++it )
+	{
+		if ( !it->m_used || !it->m_name.TopLevel() )
+		{
+			continue;
+		}
+
+		Value value = it->m_symbol.GetValue( m_context );
+
+		BeebAsm::Symbol symbol;
+		symbol.m_name = it->m_name.Name();
+		symbol.m_isLabel = it->m_symbol.IsLabel();
+		symbol.m_isString = ( value.GetType() == Value::StringValue );
+		symbol.m_number = 0;
+
+		if ( symbol.m_isString )
+		{
+			String text = value.GetString();
+			symbol.m_string.assign( text.Text(), text.Length() );
+		}
+		else
+		{
+			symbol.m_number = value.GetNumber();
+		}
+
+		symbols.push_back( symbol );
+	}
+
+	sort( symbols.begin(), symbols.end(), SymbolNameLess );
+}
+
+
+
 void SymbolTable::PushBrace()
 {
-	if (GlobalData::Instance().IsSecondPass())
+	if (m_context.GetGlobalData().IsSecondPass())
 	{
-		int addr = ObjectCode::Instance().GetPC();
+		int addr = m_context.GetObjectCode().GetPC();
 		if (m_lastLabel.m_addr != addr)
 		{
 			std::ostringstream label; label << "._" << (m_labelScopes - m_lastLabel.m_scope);
@@ -426,9 +789,9 @@ void SymbolTable::PushBrace()
 
 void SymbolTable::PushFor(const ScopedSymbolName& symbol, double value)
 {
-	if (GlobalData::Instance().IsSecondPass())
+	if (m_context.GetGlobalData().IsSecondPass())
 	{
-		int addr = ObjectCode::Instance().GetPC();
+		int addr = m_context.GetObjectCode().GetPC();
 		std::ostringstream label; label << "._" << symbol.Name() << "_" << value;
 		m_lastLabel.m_identifier += label.str();
 		m_lastLabel.m_addr  = addr;
@@ -439,9 +802,9 @@ void SymbolTable::PushFor(const ScopedSymbolName& symbol, double value)
 
 void SymbolTable::AddLabel(const std::string& symbol)
 {
-	if (GlobalData::Instance().IsSecondPass())
+	if (m_context.GetGlobalData().IsSecondPass())
 	{
-		int addr = ObjectCode::Instance().GetPC();
+		int addr = m_context.GetObjectCode().GetPC();
 		m_lastLabel.m_identifier = (m_labelStack.empty() ? "" : m_labelStack.back().m_identifier) + "." + symbol;
 		m_lastLabel.m_addr = addr;
 		m_labelList.push_back(m_lastLabel);
@@ -450,7 +813,7 @@ void SymbolTable::AddLabel(const std::string& symbol)
 
 void SymbolTable::PopScope()
 {
-	if (GlobalData::Instance().IsSecondPass())
+	if (m_context.GetGlobalData().IsSecondPass())
 	{
 		m_labelStack.pop_back();
 		m_lastLabel = m_labelStack.empty() ? Label() : m_labelStack.back();
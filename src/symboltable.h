@@ -25,33 +25,57 @@
 
 #include <cassert>
 #include <cstdlib>
-#include <unordered_map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "scopedsymbolname.h"
 #include "value.h"
 
 
+class AssemblyContext;
+
+namespace BeebAsm
+{
+	struct Symbol;
+}
+
 class SymbolTable
 {
 public:
 
-	static void Create();
-	static void Destroy();
-	static inline SymbolTable& Instance() { assert( m_gInstance != NULL ); return *m_gInstance; }
+	explicit SymbolTable( AssemblyContext& context );
+	~SymbolTable();
+
+	// A built-in symbol whose value is computed when it is referenced, e.g. P%
+	typedef Value ( *ComputedValue )( AssemblyContext& context );
 
 	void AddBuiltInSymbol( const std::string& symbol, Value value );
+	void AddComputedBuiltInSymbol( const std::string& symbol, ComputedValue computedValue );
 	void AddSymbol( const ScopedSymbolName& symbol, Value value, bool isLabel = false );
 	bool AddCommandLineSymbol( const std::string& expr );
 	bool AddCommandLineStringSymbol( const std::string& expr );
-	void ChangeBuiltInSymbol( const std::string& symbol, double value );
 	void ChangeSymbol( const ScopedSymbolName& symbol, Value value );
 	Value GetSymbol( const ScopedSymbolName& symbol ) const;
 	bool IsSymbolDefined( const ScopedSymbolName& symbol ) const;
 	void RemoveSymbol( const ScopedSymbolName& symbol );
 
+	void EnterScope( int id, int count );
+	void LeaveScope();
+	inline int GetScopeLevel() const { return static_cast< int >( m_openScopes.size() ) - 1; }
+	bool GetInnermostSymbol( int nameId, Value& value ) const;
+
+	inline bool IsVerboseSymbolSet() const
+	{
+		if ( m_verboseState == VERBOSE_UNKNOWN )
+		{
+			UpdateVerboseState();
+		}
+		return m_verboseState == VERBOSE_ON;
+	}
+
 	void Dump(bool global, bool all, const char * labels_file) const; // labels_file == nullptr -> stdout
+	void GetTopLevelSymbols( std::vector< BeebAsm::Symbol >& symbols ) const;
 
 	void PushBrace();
 	void PushFor(const ScopedSymbolName& symbol, double value);
@@ -64,25 +88,75 @@ private:
 	{
 	public:
 
-		Symbol( Value value, bool isLabel ) : m_value( value ), m_isLabel( isLabel ) {}
+		Symbol() : m_computedValue( NULL ), m_isLabel( false ) {}
+		Symbol( Value value, bool isLabel ) : m_value( value ), m_computedValue( NULL ), m_isLabel( isLabel ) {}
+		explicit Symbol( ComputedValue computedValue ) : m_computedValue( computedValue ), m_isLabel( false ) {}
 
-		void SetValue( Value value ) { m_value = value; }
-		Value GetValue() const { return m_value; }
+		void SetValue( Value value ) { assert( m_computedValue == NULL ); m_value = value; }
+		Value GetValue( AssemblyContext& context ) const { return ( m_computedValue != NULL ) ? m_computedValue( context ) : m_value; }
 		bool IsLabel() const { return m_isLabel; }
 
 	private:
 
-		Value	m_value;
-		bool	m_isLabel;
+		Value			m_value;
+		ComputedValue	m_computedValue;
+		bool			m_isLabel;
 	};
 
-	SymbolTable();
-	~SymbolTable();
+	AssemblyContext&	m_context;
+
+	// The symbols are kept in a flat open addressing hash table, probed linearly, whose size is
+	// a power of two and which is never more than half full.
+	struct Slot
+	{
+		Slot() : m_used( false ) {}
+
+		ScopedSymbolName	m_name;
+		Symbol				m_symbol;
+		bool				m_used;
+	};
+
+	size_t FindSlot( const ScopedSymbolName& symbol ) const;
+	void Grow();
+
+	std::vector<Slot>	m_slots;
+	size_t				m_numSymbols;
+
+	// Resolution of a name to the innermost scope defining it.  m_openScopes is the chain of
+	// scopes currently open (id and loop count), starting with the global scope at level 0.
+	// m_scopeNames lists the names defined in each scope other than the global one, and
+	// m_bindings holds, for each name, the levels of the open scopes which define it, innermost
+	// last.  Entering and leaving a scope pushes and pops the bindings of its names.
+	typedef std::pair<int, int> ScopeKey;
+
+	static long long PackScopeKey( int id, int count )
+	{
+		return ( static_cast< long long >( id ) << 32 ) | static_cast< unsigned int >( count );
+	}
+
+	void Bind( const ScopedSymbolName& symbol );
+	void Unbind( const ScopedSymbolName& symbol );
+	int FindOpenScope( const ScopedSymbolName& symbol ) const;
+
+	// Whether the innermost VERBOSE symbol asks for a listing.  This is consulted for every byte
+	// assembled, so it's cached, and forgotten whenever VERBOSE is defined, changed, removed, or
+	// gains or loses a binding as a scope is entered or left.
+	enum VerboseState
+	{
+		VERBOSE_UNKNOWN,
+		VERBOSE_OFF,
+		VERBOSE_ON
+	};
+
+	void UpdateVerboseState() const;
+	inline void ForgetVerboseState( int nameId ) { if ( nameId == m_verboseNameId ) m_verboseState = VERBOSE_UNKNOWN; }
 
-	typedef std::unordered_map<ScopedSymbolName, Symbol> MapType;
-	MapType m_map;
+	std::vector<ScopeKey>								m_openScopes;
+	std::unordered_map< long long, std::vector<int> >	m_scopeNames;
+	std::vector< std::vector<int> >						m_bindings;
 
-	static SymbolTable*				m_gInstance;
+	int													m_verboseNameId;
+	mutable VerboseState								m_verboseState;
 
 	int m_labelScopes;
 	struct Label
@@ -0,0 +1,231 @@
+/*************************************************************************************************/
+/**
+	libbeebasm.cpp
+
+	Tests assembling in memory through libbeebasm
+
+
+	Copyright (C) Rich Talbot-Watkins 2007 - 2012
+
+	This file is part of BeebAsm.
+
+	BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+	General Public License as published by the Free Software Foundation, either version 3 of the
+	License, or (at your option) any later version.
+
+	BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+	even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along with BeebAsm, as
+	COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*************************************************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "beebasm.h"
+
+
+using namespace std;
+
+
+static int failures = 0;
+
+#define CHECK( condition )																		\
+	do																							\
+	{																							\
+		if ( !( condition ) )																	\
+		{																						\
+			cout << __FILE__ << ":" << __LINE__ << ": check failed: " << #condition << endl;	\
+			failures++;																			\
+		}																						\
+	} while ( false )
+
+
+// Supplies files from memory, noting which were asked for
+class MemoryFileProvider : public BeebAsm::FileProvider
+{
+public:
+
+	virtual bool ReadFile( const string& filename, string& contents )
+	{
+		m_requested.push_back( filename );
+
+		map< string, string >::const_iterator it = m_files.find( filename );
+
+		if ( it == m_files.end() )
+		{
+			return false;
+		}
+
+		contents = it->second;
+		return true;
+	}
+
+	map< string, string >	m_files;
+	vector< string >		m_requested;
+};
+
+
+
+/*************************************************************************************************/
+/**
+	FindSymbol()
+
+	Returns the top level symbol with the given name, or NULL if there isn't one
+*/
+/*************************************************************************************************/
+static const BeebAsm::Symbol* FindSymbol( const BeebAsm::Result& result, const string& name )
+{
+	for ( vector< BeebAsm::Symbol >::const_iterator it = result.m_symbols.begin(); it != result.m_symbols.end(); ++it )
+	{
+		if ( it->m_name == name )
+		{
+			return &*it;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+/*************************************************************************************************/
+/**
+	TestAssembleText()
+
+	Assembles text which INCLUDEs a file supplied by a FileProvider, and SAVEs the code
+*/
+/*************************************************************************************************/
+static void TestAssembleText()
+{
+	MemoryFileProvider files;
+	files.m_files[ "sub.asm" ] =
+		".sub\n"
+		"    LDA #value\n"
+		"    RTS\n";
+
+	BeebAsm::Options options;
+	options.m_inputFile = "main.asm";
+	options.m_symbols.push_back( "value=&42" );
+
+	BeebAsm::Result result;
+
+	bool ok = BeebAsm::AssembleText(
+		"ORG &2000\n"
+		".start\n"
+		"    JSR sub\n"
+		"    RTS\n"
+		"INCLUDE \"sub.asm\"\n"
+		".end\n"
+		"greeting = \"hello\"\n"
+		"SAVE \"Code\", start, end, start + 1\n",
+		options, result, &files );
+
+	CHECK( ok );
+	CHECK( result.m_succeeded );
+	CHECK( result.m_diagnostics.empty() );
+	CHECK( files.m_requested.size() == 1 && files.m_requested[ 0 ] == "sub.asm" );
+
+	static const unsigned char code[] = { 0x20, 0x04, 0x20, 0x60, 0xA9, 0x42, 0x60 };
+
+	CHECK( result.m_memory.size() == 0x10000 );
+	CHECK( result.m_memory.size() == 0x10000 &&
+		   equal( code, code + sizeof code, result.m_memory.begin() + 0x2000 ) );
+
+	CHECK( result.m_savedFiles.size() == 1 );
+
+	if ( result.m_savedFiles.size() == 1 )
+	{
+		const BeebAsm::SavedFile& saved = result.m_savedFiles[ 0 ];
+		CHECK( saved.m_filename == "Code" );
+		CHECK( saved.m_loadAddress == 0x2000 );
+		CHECK( saved.m_execAddress == 0x2001 );
+		CHECK( saved.m_data.size() == sizeof code && equal( code, code + sizeof code, saved.m_data.begin() ) );
+	}
+
+	const BeebAsm::Symbol* sub = FindSymbol( result, "sub" );
+	CHECK( sub != NULL && sub->m_isLabel && !sub->m_isString && sub->m_number == 0x2004 );
+
+	const BeebAsm::Symbol* value = FindSymbol( result, "value" );
+	CHECK( value != NULL && !value->m_isLabel && value->m_number == 0x42 );
+
+	const BeebAsm::Symbol* greeting = FindSymbol( result, "greeting" );
+	CHECK( greeting != NULL && greeting->m_isString && greeting->m_string == "hello" );
+}
+
+
+
+/*************************************************************************************************/
+/**
+	TestSyntaxError()
+
+	Checks that a syntax error in an INCLUDEd file is reported with its location
+*/
+/*************************************************************************************************/
+static void TestSyntaxError()
+{
+	MemoryFileProvider files;
+	files.m_files[ "bad.asm" ] =
+		"NOP\n"
+		"LDA #\n";
+
+	BeebAsm::Options options;
+	options.m_inputFile = "main.asm";
+
+	BeebAsm::Result result;
+
+	bool ok = BeebAsm::AssembleText(
+		"ORG &2000\n"
+		"INCLUDE \"bad.asm\"\n",
+		options, result, &files );
+
+	CHECK( !ok );
+	CHECK( !result.m_succeeded );
+	CHECK( result.m_diagnostics.size() == 1 );
+
+	if ( result.m_diagnostics.size() == 1 )
+	{
+		const BeebAsm::Diagnostic& diagnostic = result.m_diagnostics[ 0 ];
+		CHECK( diagnostic.m_severity == BeebAsm::Diagnostic::SEVERITY_ERROR );
+		CHECK( diagnostic.m_filename == "bad.asm" );
+		CHECK( diagnostic.m_lineNumber == 2 );
+		CHECK( diagnostic.m_column == 5 );
+		CHECK( diagnostic.m_message == "Expression not found." );
+		CHECK( diagnostic.m_line == "LDA #" );
+	}
+
+	CHECK( result.m_messages.find( "bad.asm:2: error:" ) != string::npos );
+}
+
+
+
+/*************************************************************************************************/
+/**
+	main()
+*/
+/*************************************************************************************************/
+int main()
+{
+	BeebAsm::Initialise();
+
+	TestAssembleText();
+	TestSyntaxError();
+
+	BeebAsm::Shutdown();
+
+	if ( failures != 0 )
+	{
+		cout << failures << " check(s) failed" << endl;
+		return EXIT_FAILURE;
+	}
+
+	cout << "libbeebasm tests succeeded" << endl;
+	return EXIT_SUCCESS;
+}
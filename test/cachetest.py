@@ -0,0 +1,139 @@
+# =====================================================================================================
+#
+#   Copyright (C) Charles Reilly 2021
+#
+#   This file is part of BeebAsm.
+#
+#   BeebAsm is free software: you can redistribute it and/or modify it under the terms of the GNU
+#   General Public License as published by the Free Software Foundation, either version 3 of the
+#    License, or (at your option) any later version.
+#
+#   BeebAsm is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+#   even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License along with BeebAsm, as
+#   COPYING.txt.  If not, see <http://www.gnu.org/licenses/>.
+#
+# =====================================================================================================
+
+# Tests -cache by assembling the same source repeatedly in a scratch directory, checking that a
+# repeated assembly is restored from the cache with all of its outputs and messages, and that
+# changing a file it reads makes it assemble again.
+
+import os
+import sys
+import subprocess
+import tempfile
+
+class TestFailure(Exception):
+    '''A test failed'''
+    pass
+
+SOURCE = '''ORG &2000
+.start
+INCBIN "data.bin"
+.end
+PRINT "data is ", end - start, "bytes"
+IF save
+SAVE "Code", start, end
+ENDIF
+'''
+
+# Each set of options, and the files it writes
+CASES = [
+    (['-D', 'save=1', '-do', 'test.ssd', '-d', '-labels', 'labels.txt'], ['test.ssd', 'labels.txt']),
+    (['-D', 'save=1'], ['Code']),
+    (['-D', 'save=0'], [])
+]
+
+def write_file(name, contents):
+    with open(name, 'wb') as file:
+        file.write(contents)
+
+def read_file(name):
+    with open(name, 'rb') as file:
+        return file.read()
+
+def manifest_state():
+    # The manifest is replaced whenever an assembly is stored, so is untouched by a cache hit
+    names = [name for name in os.listdir('cache') if name.endswith('.manifest')]
+    return sorted((name, os.stat(os.path.join('cache', name)).st_ino,
+                   os.stat(os.path.join('cache', name)).st_mtime_ns) for name in names)
+
+def count_entries():
+    count = 0
+    for name in os.listdir('cache'):
+        if name.endswith('.manifest'):
+            count += read_file(os.path.join('cache', name)).count(b'entry ')
+    return count
+
+def assemble(beebasm, options, outputs):
+    for name in outputs:
+        if os.path.exists(name):
+            os.remove(name)
+    args = [beebasm, '-cache', 'cache', '-i', 'main.6502'] + options
+    print(args)
+    process = subprocess.run(args, stdout = subprocess.PIPE, stderr = subprocess.PIPE)
+    if process.returncode != 0:
+        raise TestFailure('Assembly failed: ' + str(args) + '\n' + process.stderr.decode())
+    for name in outputs:
+        if not os.path.exists(name):
+            raise TestFailure('Output not written: ' + name)
+    return (process.stdout, process.stderr, [read_file(name) for name in outputs])
+
+def check(condition, message):
+    if not condition:
+        raise TestFailure(message)
+
+def test_case(beebasm, options, outputs):
+    write_file('data.bin', b'AB')
+    first = assemble(beebasm, options, outputs)
+    check(b'data is 2 bytes' in first[0], 'Unexpected output: ' + first[0].decode())
+    if not outputs:
+        check(b'no SAVE command' in first[1], 'Expected a warning: ' + first[1].decode())
+
+    # Unchanged, so restored from the cache
+    state = manifest_state()
+    entries = count_entries()
+    check(assemble(beebasm, options, outputs) == first, 'Restored outputs differ: ' + str(options))
+    check(manifest_state() == state, 'Unchanged assembly was not restored from the cache: ' + str(options))
+
+    # INCBIN file changed, so assembled again and remembered alongside the first
+    write_file('data.bin', b'ABC')
+    changed = assemble(beebasm, options, outputs)
+    check(b'data is 3 bytes' in changed[0], 'Changed input not assembled: ' + changed[0].decode())
+    check(manifest_state() != state, 'Changed assembly was not stored: ' + str(options))
+    check(count_entries() == entries + 1, 'Changed assembly not remembered alongside the first: ' + str(options))
+
+    # Changed back, so the first assembly is restored
+    write_file('data.bin', b'AB')
+    state = manifest_state()
+    check(assemble(beebasm, options, outputs) == first, 'Restored outputs differ after change: ' + str(options))
+    check(manifest_state() == state, 'Earlier assembly was not restored from the cache: ' + str(options))
+
+if os.name == 'nt':
+    beebasm = 'beebasm.exe'
+else:
+    beebasm = 'beebasm'
+beebasm = os.path.join(os.getcwd(), beebasm)
+
+original_directory = os.getcwd()
+
+try:
+    with tempfile.TemporaryDirectory() as directory:
+        os.chdir(directory)
+        try:
+            os.mkdir('cache')
+            write_file('main.6502', SOURCE.encode())
+            for (options, outputs) in CASES:
+                test_case(beebasm, options, outputs)
+        finally:
+            # The scratch directory can't be removed while it's the current directory on Windows
+            os.chdir(original_directory)
+    print("SUCCESS: beebasm cache tests succeeded")
+    sys.exit(0)
+
+except TestFailure as e:
+    print("FAILURE: " + e.args[0])
+    sys.exit(1)
@@ -74,10 +74,12 @@ def read_beebasm_switches(file_name):
             return []
         return params[1:]
 
-def beebasm_args(beebasm, file_name, ssd_name):
+def beebasm_args(beebasm, file_name, ssd_name, dep_name):
     args = [beebasm, '-v'] + read_beebasm_switches(file_name)
     if ssd_name != None:
         args += ['-do', ssd_name]
+    if dep_name != None:
+        args += ['-dep', dep_name]
     args += ['-i', file_name]
     return args
 
@@ -107,14 +109,18 @@ def run_test(beebasm, path, file_names, file_name):
     failure_test = file_name.endswith('.fail.6502')
     gold_ssd = replace_extension(file_name, '.gold.ssd')
     gold_txt = replace_extension(file_name, '.gold.txt')
+    gold_dep = replace_extension(file_name, '.gold.d')
     ssd_name = None
+    dep_name = None
     gold_capture = None
     if gold_ssd in file_names:
         ssd_name = 'test.ssd'
+    if gold_dep in file_names:
+        dep_name = 'test.d'
     if gold_txt in file_names:
         gold_capture = 'testgold.txt'
 
-    result = execute_test(beebasm_args(beebasm, file_name, ssd_name), gold_capture)
+    result = execute_test(beebasm_args(beebasm, file_name, ssd_name, dep_name), gold_capture)
 
     if not gold_capture is None:
         # This won't work well if a test produces gigabytes of output.  Don't do that!
@@ -144,6 +150,14 @@ def run_test(beebasm, path, file_names, file_name):
             print(' failed')
             raise TestFailure('ssd does not match gold ssd: ' + gold_ssd)
 
+    if not failure_test and dep_name != None:
+        print('Comparing dependency file to', gold_dep, end = '')
+        if compare_files(gold_dep, dep_name):
+            print(' succeeded')
+        else:
+            print(' failed')
+            raise TestFailure('Dependency file does not match gold dependency file: ' + gold_dep)
+
 def scan_directory(beebasm):
     for (path, directory_names, file_names) in os.walk('.', topdown = True):
         # Sort directory names; this allows simpler tests to be prioritised